@@ -1,13 +1,25 @@
-#include <stdio.h>      // fprintf(), stdout, setlinebuf()
 #include <stdlib.h>     // EXIT_SUCCESS, EXIT_FAILURE, rand()
 #include <stdint.h>     // uint8_t, uint16_t, ...
-#include <inttypes.h>   // PRIu8, PRIu16, ...
-#include <unistd.h>     // getopt(), STDOUT_FILENO
-#include <math.h>       // ceil()
-#include <time.h>       // time(), nanosleep(), struct timespec
+#include <unistd.h>     // STDOUT_FILENO, write()
+#include <getopt.h>     // getopt_long(), struct option
+#include <time.h>       // time(), nanosleep(), clock_gettime(), ...
 #include <signal.h>     // sigaction(), struct sigaction
+#include <string.h>     // strstr(), strrchr(), memcpy(), memmove(), ...
+#include <poll.h>       // poll(), struct pollfd
 #include <termios.h>    // struct winsize, struct termios, tcgetattr(), ...
 #include <sys/ioctl.h>  // ioctl(), TIOCGWINSZ
+#include <errno.h>      // errno, EINTR, EEXIST
+
+// the tiny build (`make tiny`) does without stdio and all the extras
+
+#ifndef FAKESTEAK_TINY
+#include <stdio.h>      // fprintf(), stdout, setlinebuf()
+#include <inttypes.h>   // PRIu8, PRIu16, ...
+#include <fcntl.h>      // O_CREAT, O_RDWR
+#include <stdatomic.h>  // atomic_uint, atomic_store_explicit(), ...
+#include <sys/mman.h>   // shm_open(), shm_unlink(), mmap(), munmap()
+#include <pthread.h>    // pthread_create(), pthread_mutex_lock(), ...
+#endif
 
 // program information
 
@@ -46,6 +58,27 @@
 #define SPEED_FACTOR_MAX 100
 #define SPEED_FACTOR_DEF 10
 
+#define CELL_W_DEF 8         // cell width in pixels, if the terminal won't tell
+#define CELL_H_DEF 16        // cell height in pixels, if the terminal won't tell
+#define GLOW_STRENGTH 0.35   // intensity of the glow around pixel glyphs
+
+#define BUDGET_MIN 1
+#define BUDGET_MAX 100
+
+#define GOV_INTERVAL  0.5     // seconds between CPU budget governor adjustments
+#define GOV_STEP      0.05    // max change of the load factor per adjustment
+#define GOV_SMOOTHING 0.5     // weight of new CPU usage measurements
+#define GOV_TOLERANCE 0.05    // deviation from the budget that we tolerate
+#define GOV_LOAD_MIN  0.1     // never scale things down further than this
+
+#define BENCH_COLS 80        // matrix width for benchmarks without terminal
+#define BENCH_ROWS 24        // matrix height for benchmarks without terminal
+
+#define VIDEO_W_DEF      1920 // video export frame width, in pixels
+#define VIDEO_H_DEF      1080 // video export frame height, in pixels
+#define VIDEO_FRAMES_DEF 300  // number of frames to export
+#define VIDEO_THREADS_MAX 64  // rasterizer threads for video export, at most
+
 // do not change these 
 
 #define ANSI_FONT_RESET "\x1b[0m"
@@ -58,6 +91,17 @@
 #define ANSI_CLEAR_SCREEN "\x1b[2J"
 #define ANSI_CURSOR_RESET "\x1b[H"
 
+#define ANSI_SIXEL_RIGHT_ON  "\x1b[?8452h" // leave cursor right of sixel images
+#define ANSI_SIXEL_RIGHT_OFF "\x1b[?8452l" // back to default behavior
+
+#define ANSI_SYNC_BEGIN "\x1b[?2026h" // synchronized update, begin of frame
+#define ANSI_SYNC_END   "\x1b[?2026l" // synchronized update, end of frame
+#define ANSI_SYNC_QUERY "\x1b[?2026$p" // DECRQM, does the terminal know 2026?
+#define ANSI_DA1_QUERY  "\x1b[c"       // primary device attributes
+
+#define SYNC_QUERY_TIMEOUT 250 // ms to wait for the terminal to answer
+#define SYNC_REPLY_SIZE    128 // bytes to read, at most, from the answer
+
 #define BITMASK_ASCII 0x00FF
 #define BITMASK_STATE 0x0300
 #define BITMASK_TSIZE 0xFC00
@@ -72,8 +116,56 @@
 #define ASCII_MIN 32
 #define ASCII_MAX 126
 
+#define LIVE_BITS   64 // cells per word of the occupancy bitmaps
+#define LIVE_SPARSE 8  // words with this many live cells or less are sparse
+#define LIVE_DENSE  8  // rows with more than 1 in this many cells live are dense
+
 #define NS_PER_SEC 1000000000
 
+#define OUT_BUF_SIZE 16384 // stdout buffer size of the tiny build
+#define OUT_ERR_SIZE 256   // stderr buffer size of the tiny build
+
+#ifdef FAKESTEAK_TINY
+#define OPTSTRING "bd:e:hr:s:V"
+#else
+#define OPTSTRING "bB:c:d:e:hm:pr:s:tV"
+#endif
+
+#define STR(x)  #x
+#define XSTR(x) STR(x)     // turn the value of a macro into a string
+
+#define FONT_GLYPHS (ASCII_MAX - ASCII_MIN + 1)
+#define FONT_SIZE   8
+
+#define ATLAS_TILES (FONT_GLYPHS * NUM_COLORS + 1)
+#define ATLAS_BLANK (ATLAS_TILES - 1)
+
+#define SIXEL_COLORS 3       // background, glow and glyph
+#define SIXEL_DIRTY  0xFFFF  // cell needs to be drawn, no matter what
+
+#define VT_MAX_PARAMS    16      // CSI parameters we keep track of
+#define VT_COLOR_DEFAULT 0x100   // the terminal's default fg / bg color
+
+#define VT_GROUND     0          // parser states of the emulated terminal
+#define VT_ESC        1
+#define VT_CSI        2
+#define VT_STRING     3
+#define VT_STRING_ESC 4
+
+#define VIDEO_Y4M 1            // video export formats
+#define VIDEO_PPM 2
+
+#define OPT_EXPORT_Y4M 256     // long options that have no short equivalent
+#define OPT_EXPORT_PPM 257
+#define OPT_RESOLUTION 258
+#define OPT_CELL_SIZE  259
+#define OPT_FRAMES     260
+#define OPT_THREADS    261
+
+#define SHM_MAGIC   0x6b617466 // "ftak", little endian
+#define SHM_VERSION 1
+#define SHM_NAME_MAX 256
+
 // for easy access of colors later on
 
 static char *colors[] =
@@ -86,7 +178,114 @@ static char *colors[] =
 	COLOR_FG_5
 };
 
-#define NUM_COLORS sizeof(colors) / sizeof(colors[0])
+#define NUM_COLORS (sizeof(colors) / sizeof(colors[0]))
+
+#ifndef FAKESTEAK_TINY
+
+// 8x8 bitmap font for ASCII_MIN through ASCII_MAX, used for pixel graphics;
+// one byte per row, least significant bit is the left-most pixel.
+// based on the public domain font8x8 by Daniel Hepper, after the IBM PC BIOS
+
+static const uint8_t font[FONT_GLYPHS][FONT_SIZE] =
+{
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+	{ 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 }, // '!'
+	{ 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+	{ 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 }, // '#'
+	{ 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 }, // '$'
+	{ 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 }, // '%'
+	{ 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 }, // '&'
+	{ 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '''
+	{ 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 }, // '('
+	{ 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 }, // ')'
+	{ 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 }, // '*'
+	{ 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 }, // '+'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ','
+	{ 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 }, // '-'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // '.'
+	{ 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 }, // '/'
+	{ 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 }, // '0'
+	{ 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 }, // '1'
+	{ 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 }, // '2'
+	{ 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 }, // '3'
+	{ 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 }, // '4'
+	{ 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 }, // '5'
+	{ 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 }, // '6'
+	{ 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 }, // '7'
+	{ 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 }, // '8'
+	{ 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 }, // '9'
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ';'
+	{ 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 }, // '<'
+	{ 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 }, // '='
+	{ 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 }, // '>'
+	{ 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 }, // '?'
+	{ 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 }, // '@'
+	{ 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 }, // 'A'
+	{ 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 }, // 'B'
+	{ 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 }, // 'C'
+	{ 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 }, // 'D'
+	{ 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 }, // 'E'
+	{ 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 }, // 'F'
+	{ 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 }, // 'G'
+	{ 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 }, // 'H'
+	{ 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'I'
+	{ 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 }, // 'J'
+	{ 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 }, // 'K'
+	{ 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 }, // 'L'
+	{ 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 }, // 'M'
+	{ 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 }, // 'N'
+	{ 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 }, // 'O'
+	{ 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 }, // 'P'
+	{ 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 }, // 'Q'
+	{ 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 }, // 'R'
+	{ 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 }, // 'S'
+	{ 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'T'
+	{ 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 }, // 'U'
+	{ 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'V'
+	{ 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 }, // 'W'
+	{ 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 }, // 'X'
+	{ 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 }, // 'Y'
+	{ 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 }, // 'Z'
+	{ 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 }, // '['
+	{ 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 }, // '\'
+	{ 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 }, // ']'
+	{ 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 }, // '^'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, // '_'
+	{ 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '`'
+	{ 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 }, // 'a'
+	{ 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 }, // 'b'
+	{ 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 }, // 'c'
+	{ 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 }, // 'd'
+	{ 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 }, // 'e'
+	{ 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 }, // 'f'
+	{ 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'g'
+	{ 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 }, // 'h'
+	{ 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'i'
+	{ 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E }, // 'j'
+	{ 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 }, // 'k'
+	{ 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'l'
+	{ 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 }, // 'm'
+	{ 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 }, // 'n'
+	{ 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 }, // 'o'
+	{ 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F }, // 'p'
+	{ 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 }, // 'q'
+	{ 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 }, // 'r'
+	{ 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 }, // 's'
+	{ 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 }, // 't'
+	{ 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 }, // 'u'
+	{ 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'v'
+	{ 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 }, // 'w'
+	{ 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 }, // 'x'
+	{ 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'y'
+	{ 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 }, // 'z'
+	{ 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 }, // '{'
+	{ 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 }, // '|'
+	{ 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 }, // '}'
+	{ 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '~'
+};
+
+#endif
 
 // these are flags used for signal handling
 
@@ -114,38 +313,409 @@ typedef struct matrix
 	uint16_t *data;     // matrix data
 	uint16_t  cols;     // number of columns
 	uint16_t  rows;     // number of rows
+	uint8_t  *tail;     // memory for the following per-column arrays:
+	uint8_t  *tail_size; // tail size of the last DROP seen while moving
+	uint8_t  *tail_seen; // TAIL cells seen after that DROP while moving
+	uint64_t *live;     // occupancy bitmap, one bit per cell that isn't NONE
+	uint64_t *live_sum; // summary bitmap, one bit per non-zero `live` word
+	uint64_t *live_top; // `live` bits of the top row before moving
+	uint16_t  words;    // number of `live` words per row
+	uint16_t  sums;     // number of `live_sum` words per row
+	uint16_t  live_base; // bitmap row that holds matrix row 0, see mat_mov()
 	size_t drop_count;  // current number of drops
 	float  drop_ratio;  // desired ratio of drops
 }
 matrix_s;
 
+#ifndef FAKESTEAK_TINY
+
+//
+//  the shared memory segment, if requested, starts with the following header,
+//  directly followed by the matrix data, cols * rows cells in row-major order,
+//  each cell laid out exactly as described above. Readers should:
+//
+//  1. check magic and version, then map at least `size` bytes
+//  2. read `seq`; if it is odd, a frame is being written, try again
+//  3. copy cols, rows, frame and the cells they're interested in
+//  4. read `seq` again; if it changed, the copy is torn, try again
+//
+//  The segment only ever grows, so a mapping of `size` bytes stays valid.
+//  If cols * rows cells don't fit into what a reader has mapped, it needs 
+//  to remap using the current `size` before copying the cells.
+//
+
+typedef struct shm_frame
+{
+	uint32_t    magic;      // SHM_MAGIC
+	uint16_t    version;    // SHM_VERSION
+	uint16_t    cell_size;  // size of one cell, in bytes
+	atomic_uint seq;        // sequence lock, odd while writing a frame
+	uint32_t    size;       // size of the segment, in bytes
+	uint16_t    cols;       // number of columns
+	uint16_t    rows;       // number of rows
+	uint64_t    frame;      // number of frames published so far
+	uint16_t    data[];     // matrix data
+}
+shm_frame_s;
+
+typedef struct publisher
+{
+	char   name[SHM_NAME_MAX]; // name of the shared memory object
+	int    fd;                 // file descriptor of the shared memory object
+	size_t size;               // size of the mapped segment, in bytes
+	shm_frame_s *shm;          // the mapped segment
+}
+publisher_s;
+
+typedef struct atlas
+{
+	uint16_t cw;        // width of a tile (cell), in pixels
+	uint16_t ch;        // height of a tile (cell), in pixels
+	uint8_t  bg[3];     // background color
+	uint8_t *rgb;       // ATLAS_TILES tiles of cw * ch RGB pixels each
+}
+atlas_s;
+
+typedef struct sixel
+{
+	atlas_s   atlas;                // pre-tinted glyphs
+	char     *cache[ATLAS_TILES];   // sixel encoded tiles, made on demand
+	size_t    clen[ATLAS_TILES];    // length of the encoded tiles
+	uint16_t *prev;                 // tile shown in each cell, as of last frame
+	uint64_t *shown;                // cells that might not be blank, per bit
+}
+sixel_s;
+
+typedef struct stats
+{
+	uint64_t frames;     // number of frames rendered
+	uint64_t bytes;      // number of bytes of output
+	uint64_t ns_total;   // time spent overall
+	uint64_t ns_print;   // time spent rendering
+	uint64_t ns_glitch;  // time spent glitching
+	uint64_t ns_update;  // time spent updating
+}
+stats_s;
+
+typedef struct governor
+{
+	float    budget;     // CPU time we may use, in percent of one core
+	float    usage;      // CPU time we've been using, in percent (smoothed)
+	float    cost;       // CPU time per frame, in microseconds (smoothed)
+	float    load;       // factor for density, glitches and frame rate
+	uint64_t ns_cpu;     // process CPU time at last adjustment
+	uint64_t ns_wall;    // wall clock time at last adjustment
+	uint64_t frames;     // frames rendered at last adjustment
+}
+governor_s;
+
+typedef struct vt_cell
+{
+	uint8_t  glyph;      // char shown in this cell
+	uint8_t  attr;       // 1 for bold, 2 for faint
+	uint16_t fg;         // 8 bit color index or VT_COLOR_DEFAULT
+	uint16_t bg;         // 8 bit color index or VT_COLOR_DEFAULT
+}
+vt_cell_s;
+
+typedef struct vt
+{
+	vt_cell_s *cells;    // the screen, rows * cols cells
+	uint16_t   rows;     // number of rows
+	uint16_t   cols;     // number of columns
+	uint16_t   row;      // cursor row
+	uint16_t   col;      // cursor column
+	uint8_t    wrap;     // wrap before the next char (cursor is past the edge)
+	vt_cell_s  pen;      // attributes for the next char
+	uint8_t    state;    // parser state
+	uint8_t    priv;     // private marker of the current CSI sequence, if any
+	uint8_t    inter;    // intermediate byte of the current CSI sequence, if any
+	int        num;      // number of parameters of the current CSI sequence
+	int        par[VT_MAX_PARAMS]; // parameters of the current CSI sequence
+	uint64_t   bytes;    // bytes parsed
+	uint64_t   chars;    // printable chars
+	uint64_t   changed;  // cells that got new content
+	uint64_t   same;     // cells overwritten with their current content
+	uint64_t   sgr;      // SGR (color / font) sequences
+	uint64_t   moves;    // cursor movement sequences
+	uint64_t   csi_other;  // other CSI sequences (modes, erase, queries, ...)
+	uint64_t   strings;    // DCS, OSC, APC, PM and SOS strings (like sixels)
+	uint64_t   esc_other;  // other escape sequences
+	uint64_t   scrolls;    // lines scrolled
+	uint64_t   off_cells;  // cells that didn't match the matrix
+	uint64_t   off_frames; // frames that didn't match the matrix
+	uint64_t   ns_spent;   // time spent parsing and checking
+}
+vt_s;
+
+typedef struct video
+{
+	atlas_s   atlas;     // pre-tinted glyphs, in RGB
+	uint8_t  *tiles;     // the atlas tiles as written: RGB or Y, Cb, Cr planes
+	uint8_t   format;    // VIDEO_Y4M or VIDEO_PPM
+	uint16_t  width;     // frame width, in pixels
+	uint16_t  height;    // frame height, in pixels
+	uint16_t  cols;      // number of matrix columns
+	uint16_t  rows;      // number of matrix rows
+	size_t    size;      // bytes per frame, without the frame header
+	int       slots;     // frames in flight; each has its own slot
+	uint16_t *cells;     // matrix snapshot of each slot, then atlas tiles
+	uint8_t  *pixels;    // rasterized frame of each slot
+	uint8_t  *done;      // whether the frame in each slot is rasterized
+	uint64_t  queued;    // frames handed to the rasterizers
+	uint64_t  claimed;   // frames a rasterizer has started on
+	uint64_t  written;   // frames written to the output
+	int       quit;      // tells the rasterizers to call it a day
+	int       threads;   // number of rasterizer threads running
+	pthread_t *workers;  // the rasterizer threads
+	pthread_mutex_t lock; // protects the counters, `done` and `quit`
+	pthread_cond_t  cond; // signals changes to any of those
+}
+video_s;
+
+#endif
+
 typedef struct options
 {
 	uint8_t speed;         // speed factor
 	uint8_t drops;         // drops ratio / factor
 	uint8_t error;         // error ratio / factor
 	time_t  rands;         // seed for rand()
+	char   *shm;           // name of shared memory object to publish to
+	uint32_t bench;        // number of frames to benchmark
+	uint8_t budget;        // CPU budget, in percent
+	uint8_t video;         // video export format, if any
+	uint16_t video_w;      // video frame width, in pixels
+	uint16_t video_h;      // video frame height, in pixels
+	uint16_t cell_w;       // video cell width, in pixels
+	uint16_t cell_h;       // video cell height, in pixels
+	uint32_t frames;       // number of video frames to export
+	uint8_t threads;       // number of rasterizer threads for video export
 	uint8_t bg : 1;        // use background color
+	uint8_t sixel : 1;     // use sixel graphics instead of text
+	uint8_t vt : 1;        // feed benchmark output to an emulated terminal
 	uint8_t help : 1;      // show help and exit
 	uint8_t version : 1;   // show version and exit
 }
 options_s;
 
+//
+// Functions to write output; the tiny build does its own buffering
+//
+
+#ifdef FAKESTEAK_TINY
+
+typedef struct out
+{
+	int    fd;      // file descriptor to write to
+	char  *buf;     // the buffer
+	size_t size;    // size of the buffer
+	size_t used;    // number of bytes in the buffer
+}
+out_s;
+
+// buffers live in .bss, so they don't take up space in the binary
+static char out_stdout_buf[OUT_BUF_SIZE];
+static char out_stderr_buf[OUT_ERR_SIZE];
+
+static out_s out_stdout = { STDOUT_FILENO, out_stdout_buf, OUT_BUF_SIZE };
+static out_s out_stderr = { STDERR_FILENO, out_stderr_buf, OUT_ERR_SIZE };
+
+#define OUT_STDOUT (&out_stdout)
+#define OUT_STDERR (&out_stderr)
+
+/*
+ * Write everything buffered so far to the file descriptor.
+ */
+static void
+out_flush(out_s *out)
+{
+	char *buf = out->buf;
+	while (out->used > 0)
+	{
+		ssize_t w = write(out->fd, buf, out->used);
+		if (w == -1 && errno == EINTR)
+		{
+			continue; // interrupted by a signal, like SIGWINCH
+		}
+		if (w <= 0)
+		{
+			break;
+		}
+		buf += w;
+		out->used -= w;
+	}
+	out->used = 0;
+}
+
+/*
+ * Add a single char to the buffer, flushing first if it is full.
+ */
+static void
+out_putc(out_s *out, char c)
+{
+	if (out->used == out->size)
+	{
+		out_flush(out);
+	}
+	out->buf[out->used++] = c;
+}
+
+/*
+ * Add a string to the buffer, flushing as needed.
+ */
+static void
+out_puts(out_s *out, const char *str)
+{
+	while (*str)
+	{
+		out_putc(out, *str++);
+	}
+}
+
+/*
+ * Add `len` bytes from `buf` to the buffer, flushing as needed.
+ */
+static void
+out_write(out_s *out, const char *buf, size_t len)
+{
+	while (len--)
+	{
+		out_putc(out, *buf++);
+	}
+}
+
+/*
+ * We always buffer fully and flush ourselves, nothing to do.
+ */
+static void
+out_buffered(out_s *out, int full)
+{
+}
+
+#else
+
+typedef FILE out_s;
+
+#define OUT_STDOUT stdout
+#define OUT_STDERR stderr
+
+static void
+out_flush(out_s *out)
+{
+	fflush(out);
+}
+
+static void
+out_putc(out_s *out, char c)
+{
+	fputc(c, out);
+}
+
+static void
+out_puts(out_s *out, const char *str)
+{
+	fputs(str, out);
+}
+
+static void
+out_write(out_s *out, const char *buf, size_t len)
+{
+	fwrite(buf, 1, len, out);
+}
+
+/*
+ * Switch between full (we're adult and flush ourselves) and line buffering.
+ */
+static void
+out_buffered(out_s *out, int full)
+{
+	setvbuf(out, NULL, full ? _IOFBF : _IOLBF, 0);
+}
+
+#endif
+
+/*
+ * Print `num` spaces to `out`, in chunks, which beats doing it one by one.
+ */
+static void
+out_spaces(out_s *out, size_t num)
+{
+	static const char spaces[] = "                                "
+	                             "                                ";
+	size_t chunk = sizeof(spaces) - 1;
+
+	for (; num > chunk; num -= chunk)
+	{
+		out_write(out, spaces, chunk);
+	}
+	out_write(out, spaces, num);
+}
+
+/*
+ * Print the given error message to stderr.
+ */
+static void
+out_error(const char *msg)
+{
+	out_puts(OUT_STDERR, msg);
+	out_putc(OUT_STDERR, '\n');
+	out_flush(OUT_STDERR);
+}
+
+#ifndef FAKESTEAK_TINY
+/*
+ * Parse a size given as "WIDTHxHEIGHT", like "1920x1080", into `w` and `h`.
+ * Both are set to 0 if the string doesn't look like that.
+ */
+static void
+parse_size(const char *str, uint16_t *w, uint16_t *h)
+{
+	char *end = NULL;
+	long  x = strtol(str, &end, 10);
+	long  y = *end == 'x' ? strtol(end + 1, &end, 10) : 0;
+
+	int valid = *end == '\0' && x > 0 && y > 0 && x <= UINT16_MAX && y <= UINT16_MAX;
+	*w = valid ? x : 0;
+	*h = valid ? y : 0;
+}
+#endif
+
 /*
  * Parse command line args into the provided options_s struct.
  */
 static void
 parse_args(int argc, char **argv, options_s *opts)
 {
+	static struct option long_opts[] =
+	{
+#ifndef FAKESTEAK_TINY
+		{ "cpu-budget", required_argument, NULL, 'c' },
+		{ "export-y4m", no_argument,       NULL, OPT_EXPORT_Y4M },
+		{ "export-ppm", no_argument,       NULL, OPT_EXPORT_PPM },
+		{ "resolution", required_argument, NULL, OPT_RESOLUTION },
+		{ "cell-size",  required_argument, NULL, OPT_CELL_SIZE  },
+		{ "frames",     required_argument, NULL, OPT_FRAMES     },
+		{ "threads",    required_argument, NULL, OPT_THREADS    },
+#endif
+		{ 0 }
+	};
+
 	opterr = 0;
 	int o;
-	while ((o = getopt(argc, argv, "bd:e:hr:s:V")) != -1)
+	while ((o = getopt_long(argc, argv, OPTSTRING, long_opts, NULL)) != -1)
 	{
 		switch (o)
 		{
 			case 'b':
 				opts->bg = 1;
 				break;
+			case 'B':
+				opts->bench = atol(optarg);
+				break;
+			case 'c':
+				opts->budget = atoi(optarg);
+				break;
 			case 'd':
 				opts->drops = atoi(optarg);
 				break;
@@ -155,15 +725,44 @@ parse_args(int argc, char **argv, options_s *opts)
 			case 'h':
 				opts->help = 1;
 				break;
+			case 'm':
+				opts->shm = optarg;
+				break;
+			case 'p':
+				opts->sixel = 1;
+				break;
 			case 'r':
 				opts->rands = atol(optarg);
 				break;
 			case 's':
 				opts->speed = atoi(optarg);
 				break;
+			case 't':
+				opts->vt = 1;
+				break;
 			case 'V':
 				opts->version = 1;
 				break;
+#ifndef FAKESTEAK_TINY
+			case OPT_EXPORT_Y4M:
+				opts->video = VIDEO_Y4M;
+				break;
+			case OPT_EXPORT_PPM:
+				opts->video = VIDEO_PPM;
+				break;
+			case OPT_RESOLUTION:
+				parse_size(optarg, &opts->video_w, &opts->video_h);
+				break;
+			case OPT_CELL_SIZE:
+				parse_size(optarg, &opts->cell_w, &opts->cell_h);
+				break;
+			case OPT_FRAMES:
+				opts->frames = atol(optarg);
+				break;
+			case OPT_THREADS:
+				opts->threads = atoi(optarg);
+				break;
+#endif
 		}
 	}
 }
@@ -172,32 +771,68 @@ parse_args(int argc, char **argv, options_s *opts)
  * Print usage information.
  */
 static void
-help(const char *invocation, FILE *where)
+help(const char *invocation, out_s *where)
 {
-	fprintf(where, "USAGE\n");
-	fprintf(where, "\t%s [OPTIONS...]\n\n", invocation);
-	fprintf(where, "OPTIONS\n");
-	fprintf(where, "\t-b\tuse black background color\n");
-	fprintf(where, "\t-d\tdrops ratio (%"PRIu8" .. %"PRIu8", default: %"PRIu8")\n",
-		       	DROPS_FACTOR_MIN, DROPS_FACTOR_MAX, DROPS_FACTOR_DEF);
-	fprintf(where, "\t-e\terror ratio (%"PRIu8" .. %"PRIu8", default: %"PRIu8")\n", 
-			ERROR_FACTOR_MIN, ERROR_FACTOR_MAX, ERROR_FACTOR_DEF);
-	fprintf(where, "\t-h\tprint this help text and exit\n");
-	fprintf(where, "\t-r\tseed for the random number generator\n");
-	fprintf(where, "\t-s\tspeed factor (%"PRIu8" .. %"PRIu8", default: %"PRIu8")\n", 
-			SPEED_FACTOR_MIN, SPEED_FACTOR_MAX, SPEED_FACTOR_DEF);
-	fprintf(where, "\t-V\tprint version information and exit\n");
+	out_puts(where, "USAGE\n");
+	out_puts(where, "\t");
+	out_puts(where, invocation);
+	out_puts(where, " [OPTIONS...]\n\n");
+	out_puts(where, "OPTIONS\n");
+	out_puts(where, "\t-b\tuse black background color\n");
+#ifndef FAKESTEAK_TINY
+	out_puts(where, "\t-B\trender this many frames to memory, print stats, exit\n");
+	out_puts(where, "\t-c, --cpu-budget\n");
+	out_puts(where, "\t\tadapt density, glitches and frame rate to this CPU usage\n");
+	out_puts(where, "\t\tin percent of one core (" 
+			XSTR(BUDGET_MIN) " .. " XSTR(BUDGET_MAX) ", default: off)\n");
+#endif
+	out_puts(where, "\t-d\tdrops ratio (" 
+			XSTR(DROPS_FACTOR_MIN) " .. " XSTR(DROPS_FACTOR_MAX) 
+			", default: " XSTR(DROPS_FACTOR_DEF) ")\n");
+	out_puts(where, "\t-e\terror ratio (" 
+			XSTR(ERROR_FACTOR_MIN) " .. " XSTR(ERROR_FACTOR_MAX) 
+			", default: " XSTR(ERROR_FACTOR_DEF) ")\n");
+	out_puts(where, "\t-h\tprint this help text and exit\n");
+#ifndef FAKESTEAK_TINY
+	out_puts(where, "\t-m\tpublish the matrix to this shared memory object\n");
+	out_puts(where, "\t-p\tuse sixel pixel graphics instead of text\n");
+#endif
+	out_puts(where, "\t-r\tseed for the random number generator\n");
+	out_puts(where, "\t-s\tspeed factor (" 
+			XSTR(SPEED_FACTOR_MIN) " .. " XSTR(SPEED_FACTOR_MAX) 
+			", default: " XSTR(SPEED_FACTOR_DEF) ")\n");
+#ifndef FAKESTEAK_TINY
+	out_puts(where, "\t-t\twith -B, check output with a built-in terminal emulator\n");
+#endif
+	out_puts(where, "\t-V\tprint version information and exit\n");
+#ifndef FAKESTEAK_TINY
+	out_puts(where, "\t--export-y4m, --export-ppm\n");
+	out_puts(where, "\t\twrite frames to stdout as Y4M or PPM video, then exit\n");
+	out_puts(where, "\t--resolution\n");
+	out_puts(where, "\t\tvideo frame size in pixels (default: " 
+			XSTR(VIDEO_W_DEF) "x" XSTR(VIDEO_H_DEF) ")\n");
+	out_puts(where, "\t--cell-size\n");
+	out_puts(where, "\t\tvideo cell size in pixels (default: " 
+			XSTR(CELL_W_DEF) "x" XSTR(CELL_H_DEF) ")\n");
+	out_puts(where, "\t--frames\n");
+	out_puts(where, "\t\tnumber of video frames (default: " 
+			XSTR(VIDEO_FRAMES_DEF) ")\n");
+	out_puts(where, "\t--threads\n");
+	out_puts(where, "\t\tvideo rasterizer threads (default: one per core)\n");
+#endif
+	out_flush(where);
 }
 
 /*
  * Print version information.
  */
 static void
-version(FILE *where)
+version(out_s *where)
 {
-	fprintf(where, "%s %d.%d.%d\n%s\n", PROGRAM_NAME,
-			PROGRAM_VER_MAJOR, PROGRAM_VER_MINOR, PROGRAM_VER_PATCH,
-			PROGRAM_URL);
+	out_puts(where, PROGRAM_NAME " " XSTR(PROGRAM_VER_MAJOR) "." 
+			XSTR(PROGRAM_VER_MINOR) "." XSTR(PROGRAM_VER_PATCH) "\n"
+			PROGRAM_URL "\n");
+	out_flush(where);
 }
 
 /*
@@ -211,6 +846,7 @@ on_signal(int sig)
 		case SIGWINCH:
 			resized = 1;
 			break;
+		case SIGHUP:
 		case SIGINT:
 		case SIGQUIT:
 		case SIGTERM:
@@ -229,6 +865,17 @@ clamp_uint8(uint8_t *val, uint8_t min, uint8_t max)
 	if (*val > max) { *val = max; return; }
 }
 
+/*
+ * Turn the given number of seconds into a timespec struct.
+ */
+static struct timespec
+time_ts(float secs)
+{
+	struct timespec ts = { .tv_sec = (time_t) secs };
+	ts.tv_nsec = (secs - ts.tv_sec) * NS_PER_SEC;
+	return ts;
+}
+
 /*
  * Return a pseudo-random int in the range [min, max].
  */
@@ -324,15 +971,6 @@ mat_get_value(matrix_s *mat, int row, int col)
 	return mat->data[mat_idx(mat, row, col)];
 }
 
-/*
- * Get the 2 bit cell state from the cell at the given row and column.
- */
-static uint8_t
-mat_get_state(matrix_s *mat, int row, int col)
-{
-	return val_get_state(mat_get_value(mat, row, col));
-}
-
 /*
  * Set the 16 bit matrix value for the cell at the given row and column.
  */
@@ -344,6 +982,81 @@ mat_set_value(matrix_s *mat, int row, int col, uint16_t value)
 	return mat->data[mat_idx(mat, row, col)] = value;
 }
 
+/*
+ * Get the `live` words of the given matrix row. The bitmap rows are used as a 
+ * ring buffer, so moving all rows down by one only takes a change of 
+ * `live_base`, instead of moving all the bits around.
+ */
+static uint64_t *
+mat_live_bits(matrix_s *mat, int row)
+{
+	row += mat->live_base;
+	row -= row >= mat->rows ? mat->rows : 0;
+	return mat->live + (size_t) row * mat->words;
+}
+
+/*
+ * Get the `live_sum` words of the given matrix row, see mat_live_bits().
+ */
+static uint64_t *
+mat_live_sums(matrix_s *mat, int row)
+{
+	row += mat->live_base;
+	row -= row >= mat->rows ? mat->rows : 0;
+	return mat->live_sum + (size_t) row * mat->sums;
+}
+
+/*
+ * Mark the cell at the given row and column as live (not NONE) or not in the
+ * occupancy bitmap, keeping the summary bitmap up to date as well.
+ */
+static void
+mat_set_live(matrix_s *mat, int row, int col, int live)
+{
+	if (row >= mat->rows) return;
+	if (col >= mat->cols) return;
+
+	int word = col / LIVE_BITS;
+	uint64_t *bits = mat_live_bits(mat, row) + word;
+	uint64_t *sums = mat_live_sums(mat, row) + word / LIVE_BITS;
+
+	if (live)
+	{
+		*bits |= (uint64_t) 1 << (col  % LIVE_BITS);
+		*sums |= (uint64_t) 1 << (word % LIVE_BITS);
+	}
+	else
+	{
+		*bits &= ~((uint64_t) 1 << (col % LIVE_BITS));
+	}
+	if (*bits == 0)
+	{
+		*sums &= ~((uint64_t) 1 << (word % LIVE_BITS));
+	}
+}
+
+/*
+ * Find the first non-zero `live` word in the given row, starting at `word`;
+ * the summary bitmap lets us jump over up to 64 empty words at once.
+ * Returns the index of that word, or the number of words if there is none.
+ */
+static int
+mat_next_word(matrix_s *mat, int row, int word)
+{
+	uint64_t *sums = mat_live_sums(mat, row);
+	uint64_t  s    = 0;
+
+	for (; word < mat->words; word = (word / LIVE_BITS + 1) * LIVE_BITS)
+	{
+		s = sums[word / LIVE_BITS] & (~(uint64_t) 0 << (word % LIVE_BITS));
+		if (s)
+		{
+			return word / LIVE_BITS * LIVE_BITS + __builtin_ctzll(s);
+		}
+	}
+	return mat->words;
+}
+
 /*
  * Set the 8 bit ASCII char for the cell at the given row and column.
  */
@@ -363,6 +1076,7 @@ mat_set_state(matrix_s *mat, int row, int col, uint8_t state)
 {
 	uint16_t value = mat_get_value(mat, row, col);
 	uint8_t  tsize = state == STATE_NONE ? 0 : val_get_tsize(value);
+	mat_set_live(mat, row, col, state != STATE_NONE);
 	return mat_set_value(mat, row, col, 
 			val_new(val_get_ascii(value), state, tsize));
 }
@@ -403,44 +1117,47 @@ mat_glitch(matrix_s *mat, float fraction)
 }
 
 /*
- * Print the matrix to stdout.
+ * Print the matrix to `out`. We jump from one live cell to the next, printing
+ * the empty cells in between as one run of spaces.
  */
 static void
-mat_print(matrix_s *mat)
+mat_print(matrix_s *mat, out_s *out)
 {
 	uint16_t value = 0;
-	uint8_t  state = STATE_NONE;
 	size_t   size  = mat->cols * mat->rows;
+	size_t   next  = 0; // index of the next cell to print
+	size_t   i     = 0;
 
-	for (int i = 0; i < size; ++i)
+	for (int row = 0; row < mat->rows; ++row)
 	{
-		value = mat->data[i];
-		state = val_get_state(value);
+		uint64_t *bits = mat_live_bits(mat, row);
 
-		// fputc() + fputs() is faster than one call to printf()
-		// TODO investigate if the *_unlocked functions are faster;
-		//      and also, if faster, are they safe to use here?
-
-		switch (state)
+		for (int word = mat_next_word(mat, row, 0); word < mat->words;
+				word = mat_next_word(mat, row, word + 1))
 		{
-			case STATE_NONE:
-				fputc(' ', stdout);
-				//fputc_unlocked(' ', stdout);
-				break;
-			case STATE_DROP:
-				fputs(colors[0], stdout);
-				fputc(val_get_ascii(value), stdout);
-				//fputc_unlocked(val_get_ascii(value), stdout);
-				break;
-			case STATE_TAIL:
-				fputs(colors[val_get_tsize(value)], stdout);
-				fputc(val_get_ascii(value), stdout);
-				//fputc_unlocked(val_get_ascii(value), stdout);
-				break;
+			for (uint64_t b = bits[word]; b; b &= b - 1)
+			{
+				i = mat_idx(mat, row, word * LIVE_BITS + __builtin_ctzll(b));
+				value = mat->data[i];
+
+				// the empty cells since the last live one, then this one
+				out_spaces(out, i - next);
+				switch (val_get_state(value))
+				{
+					case STATE_DROP:
+						out_puts(out, colors[0]);
+						out_putc(out, val_get_ascii(value));
+						break;
+					case STATE_TAIL:
+						out_puts(out, colors[val_get_tsize(value)]);
+						out_putc(out, val_get_ascii(value));
+						break;
+				}
+				next = i + 1;
+			}
 		}
 	}
-
-	fflush(stdout);
+	out_spaces(out, size - next);
 }
 
 /*
@@ -453,14 +1170,24 @@ mat_put_cell_drop(matrix_s *mat, int row, int col, int tsize)
 	mat_set_tsize(mat, row, col, tsize);
 }
 
+/*
+ * Get the color index for the `tnext`th TAIL cell of a DROP with `tsize`.
+ */
+static uint8_t
+mat_tail_color(int tsize, int tnext)
+{
+	// tnext / tsize is 1 for the end of the trace, 0.x for the beginning;
+	// scale that to the color index, rounding up (integer ceil division)
+	return ((NUM_COLORS-1) * tnext + tsize - 1) / tsize;
+}
+
 /*
  * Turn the specified cell into a TAIL cell.
  */
 static void
 mat_put_cell_tail(matrix_s *mat, int row, int col, int tsize, int tnext)
 {
-	float intensity = (float) tnext / (float) tsize; // 1 for end of trace, 0.x for beginning
-	int color = ceil((NUM_COLORS-1) * intensity);
+	int color = mat_tail_color(tsize, tnext);
 	mat_set_state(mat, row, col, STATE_TAIL);
 	mat_set_tsize(mat, row, col, color);
 }
@@ -519,140 +1246,1652 @@ mat_rain(matrix_s *mat)
 }
 
 /*
- * Move every cell down one row, potentially adding a new tail cell at the top.
- * Returns 1 if a DROP 'fell off the bottom', otherwise 0.
+ * Move `num` cells from `src` down to `dst`, or off the matrix if `dst` is 
+ * NULL, leaving the chars where they are. Keeps track of the tail length of 
+ * the last DROP seen in each column, and of how many TAIL cells followed it,
+ * in `size` and `seen`. Returns the number of DROPs that were moved.
  */
 static int
-mat_mov_col(matrix_s *mat, int col)
+mat_mov_cells(uint16_t *restrict src, uint16_t *restrict dst,
+		uint8_t *restrict size, uint8_t *restrict seen, int num)
 {
-	uint8_t tail_size = 0;
-	uint8_t tail_seen = 0;
-
-	uint16_t value = 0;
-	uint8_t  state = STATE_NONE;
-	uint8_t  tsize = 0;
+	int dropped = 0;
 
-	// manually check the bottom-most cell: is it a DROP?
-	int dropped = mat_get_state(mat, mat->rows - 1, col) == STATE_DROP;
+	// no bounds checks, calls or branches in these loops, so they vectorize
 
-	// iterate all cells in this column, moving each down one cell
-	for (int row = mat->rows - 1; row >= 0; --row)
+	// keep track of the tail length of the last seen drop
+	for (int col = 0; col < num; ++col)
 	{
-		// get the current cell's meta data
-		value = mat_get_value(mat, row, col);
-		state = val_get_state(value);
-		tsize = val_get_tsize(value);
+		uint8_t state = val_get_state(src[col]);
+		uint8_t drop  = state == STATE_DROP;
+		uint8_t tail  = state == STATE_TAIL;
 
-		// nothing to do if this cell is neither DROP nor TAIL
-		if (state == STATE_NONE)
-		{
-			continue;
-		}
+		seen[col] = drop ? 0 : seen[col] + (tail && size[col] > 0);
+		size[col] = drop ? val_get_tsize(src[col]) : size[col];
+		dropped  += drop;
+	}
 
-		// move the cell one down
-		mat_set_state(mat, row+1, col, state);
-		mat_set_tsize(mat, row+1, col, tsize);
+	// move the cells one down, if there is a row below
+	if (dst)
+	{
+		for (int col = 0; col < num; ++col)
+		{
+			uint16_t value = src[col];
+			uint16_t moved = value & BITMASK_STATE ? ~BITMASK_ASCII : 0;
+
+			dst[col] = (dst[col] & ~moved) | (value & moved);
+			src[col] = value & ~moved;
+		}
+		return dropped;
+	}
+
+	for (int col = 0; col < num; ++col)
+	{
+		uint16_t value = src[col];
+		src[col] = value & BITMASK_STATE ? value & BITMASK_ASCII : value;
+	}
+	return dropped;
+}
+
+/*
+ * Move a single live cell from `src` down to `dst`, or off the matrix if 
+ * `dst` is NULL; see mat_mov_cells(). Returns 1 if it was a DROP, else 0.
+ */
+static int
+mat_mov_cell(uint16_t *src, uint16_t *dst, uint8_t *size, uint8_t *seen)
+{
+	uint16_t value = *src;
+	int      drop  = val_get_state(value) == STATE_DROP;
+
+	*seen = drop ? 0 : *seen + (*size > 0);
+	*size = drop ? val_get_tsize(value) : *size;
+
+	// the cell below has been moved before, so it is empty
+	if (dst)
+	{
+		*dst = (*dst & BITMASK_ASCII) | (value & ~BITMASK_ASCII);
+	}
+	*src = value & BITMASK_ASCII;
+	return drop;
+}
+
+/*
+ * Move the given span of columns of the given row down one row, or off the 
+ * matrix if `dst` is NULL, all in one go. Returns the number of DROPs moved.
+ */
+static int
+mat_mov_span(matrix_s *mat, uint16_t *src, uint16_t *dst, int from, int to)
+{
+	to = to > mat->cols ? mat->cols : to;
+	return from < to ? mat_mov_cells(src + from, dst ? dst + from : NULL,
+			mat->tail_size + from, mat->tail_seen + from, to - from) : 0;
+}
+
+/*
+ * Move the cells of the given row down one row, or off the matrix if it is the
+ * bottom row. Runs of 64 cells that the occupancy bitmap says are all empty 
+ * are skipped; sparse ones are handled cell by cell, and neighbouring dense 
+ * ones are handled in one go. Leaves the bitmaps alone.
+ * Returns the number of DROPs that 'fell off the bottom'.
+ */
+static int
+mat_mov_row(matrix_s *mat, int row)
+{
+	uint16_t *src  = mat->data + (size_t) row * mat->cols;
+	uint16_t *dst  = row < mat->rows - 1 ? src + mat->cols : NULL;
+	uint64_t *bits = mat_live_bits(mat, row);
+	int dropped = 0;
+	int from = 0; // span of dense columns we didn't move yet
+	int to   = 0;
+	int col  = 0;
+	int live = 0;
+
+	for (int word = 0; word < mat->words; ++word)
+	{
+		live += __builtin_popcountll(bits[word]);
+	}
+	if (live * LIVE_DENSE > mat->cols)
+	{
+		dropped = mat_mov_cells(src, dst, mat->tail_size, mat->tail_seen, mat->cols);
+		return dst ? 0 : dropped;
+	}
+
+	for (int word = mat_next_word(mat, row, 0); word < mat->words;
+			word = mat_next_word(mat, row, word + 1))
+	{
+		col = word * LIVE_BITS;
+
+		if (__builtin_popcountll(bits[word]) > LIVE_SPARSE)
+		{
+			// grow the span if we can, otherwise move it and start anew
+			if (col != to)
+			{
+				dropped += mat_mov_span(mat, src, dst, from, to);
+				from = col;
+			}
+			to = col + LIVE_BITS;
+			continue;
+		}
+
+		for (uint64_t b = bits[word]; b; b &= b - 1)
+		{
+			col = word * LIVE_BITS + __builtin_ctzll(b);
+			dropped += mat_mov_cell(src + col, dst ? dst + col : NULL,
+					mat->tail_size + col, mat->tail_seen + col);
+		}
+	}
+	dropped += mat_mov_span(mat, src, dst, from, to);
+
+	return dst ? 0 : dropped;
+}
+
+/*
+ * Move every cell down one row, potentially adding new tail cells at the top.
+ * We sweep the matrix row by row, from the bottom up, skipping the parts
+ * that the occupancy bitmap says are empty; then we rotate the bitmap rows.
+ * Returns the number of DROPs that 'fell off the bottom'.
+ */
+static int
+mat_mov(matrix_s *mat)
+{
+	size_t words = mat->words;
+
+	// remember the top row, it decides about new tail cells
+	memcpy(mat->live_top, mat_live_bits(mat, 0), sizeof(*mat->live) * words);
+	memset(mat->tail_size, 0, mat->cols);
+	memset(mat->tail_seen, 0, mat->cols);
+
+	// only DROPs in the bottom row can fall off, it has nowhere to go
+	int dropped = mat_mov_row(mat, mat->rows - 1);
+	for (int row = mat->rows - 2; row >= 0; --row)
+	{
+		mat_mov_row(mat, row);
+	}
+
+	// all live cells moved down one row, the bottom ones fell off; so the 
+	// bitmap row of the bottom row becomes the one of the (empty) top row
+	mat->live_base = (mat->live_base ? mat->live_base : mat->rows) - 1;
+	uint64_t *bits = mat_live_bits(mat, 0);
+	uint64_t *sums = mat_live_sums(mat, 0);
+	memset(sums, 0, sizeof(*mat->live_sum) * mat->sums);
+
+	// if the top-most cell wasn't empty, we might have to add a tail cell;
+	// the top row is empty now, so we set its cells and bits directly
+	uint16_t *top = mat->data;
+	for (int word = 0; word < words; ++word)
+	{
+		uint64_t added = 0;
+		for (uint64_t b = mat->live_top[word]; b; b &= b - 1)
+		{
+			int col = word * LIVE_BITS + __builtin_ctzll(b);
+			if (mat->tail_seen[col] < mat->tail_size[col])
+			{
+				top[col] = val_new(val_get_ascii(top[col]), STATE_TAIL, 
+						mat_tail_color(mat->tail_size[col], mat->tail_seen[col] + 1));
+				added |= b & -b;
+			}
+		}
+		bits[word] = added;
+		sums[word / LIVE_BITS] |= added ? (uint64_t) 1 << (word % LIVE_BITS) : 0;
+	}
+
+	return dropped;
+}
+
+/*
+ * Update the matrix by moving all drops down one cell and potentially 
+ * adding new drops at the top of the matrix.
+ */
+static void 
+mat_update(matrix_s *mat)
+{
+	// move everything down one cell, possibly dropping some drops
+	mat->drop_count -= mat_mov(mat);
+	
+	// add new drops at the top, trying to get to the desired drop count
+	int drops_desired = (mat->cols * mat->rows) * mat->drop_ratio;
+	int drops_missing = drops_desired - mat->drop_count; 
+
+	// round up; integer division truncates towards zero, which for a 
+	// negative number of missing drops is the same as rounding up
+	int drops_to_add  = drops_missing > 0 ?
+		(drops_missing + mat->rows - 1) / mat->rows : drops_missing / mat->rows;
+
+	for (int i = 0; i <= drops_to_add; ++i)
+	{
+		mat_add_drop(mat, 0, rand_int(0, mat->cols - 1), 
+				rand_int(TSIZE_MIN, TSIZE_MAX));
+	}
+}
+
+/*
+ * Fill the entire matrix with random characters, setting all cells to state
+ * STATE_NONE in the process.
+ */
+static void
+mat_fill(matrix_s *mat)
+{
+	mat->live_base = 0;
+	memset(mat->live, 0, sizeof(*mat->live) * mat->words * mat->rows);
+	memset(mat->live_sum, 0, sizeof(*mat->live_sum) * mat->sums * mat->rows);
+
+	for (int r = 0; r < mat->rows; ++r)
+	{
+		for (int c = 0; c < mat->cols; ++c)
+		{
+			mat_set_state(mat, r, c, STATE_NONE);
+			mat_set_ascii(mat, r, c, rand_ascii());
+		}
+	}
+}
+
+/*
+ * Creates or recreates (resizes) the given matrix.
+ * Returns -1 on error (out of memory), 0 on success.
+ */
+static int
+mat_init(matrix_s *mat, uint16_t rows, uint16_t cols, float drop_ratio)
+{
+	mat->data = realloc(mat->data, sizeof(mat->data) * rows * cols);
+	if (mat->data == NULL)
+	{
+		return -1;
+	}
+
+	mat->tail = realloc(mat->tail, 2 * cols);
+	if (mat->tail == NULL)
+	{
+		return -1;
+	}
+	mat->tail_size = mat->tail;
+	mat->tail_seen = mat->tail + cols;
+
+	// one more row of `live` words, to remember the top row while moving
+	mat->words = (cols + LIVE_BITS - 1) / LIVE_BITS;
+	mat->sums  = (mat->words + LIVE_BITS - 1) / LIVE_BITS;
+
+	mat->live = realloc(mat->live, sizeof(*mat->live) * mat->words * (rows + 1));
+	mat->live_sum = realloc(mat->live_sum, sizeof(*mat->live_sum) * mat->sums * rows);
+	if (mat->live == NULL || mat->live_sum == NULL)
+	{
+		return -1;
+	}
+	mat->live_top = mat->live + (size_t) mat->words * rows;
+	
+	mat->rows = rows;
+	mat->cols = cols;
+
+	mat->drop_count = 0;
+	mat->drop_ratio = drop_ratio;
+	
+	return 0;
+}
+
+/*
+ * Free ALL the memory \o/
+ */
+void
+mat_free(matrix_s *mat)
+{
+	free(mat->data);
+	free(mat->tail);
+	free(mat->live);
+	free(mat->live_sum);
+}
+
+#ifndef FAKESTEAK_TINY
+
+//
+// Functions to turn the matrix into pixels
+//
+
+/*
+ * Get the 8 bit color index from an ANSI color escape sequence, like the 
+ * ones used for `colors[]`: it's the number between the last ';' and the 'm'.
+ */
+static int
+color_index(const char *ansi)
+{
+	const char *semi = strrchr(ansi, ';');
+	return semi ? atoi(semi + 1) : 0;
+}
+
+/*
+ * Convert the given 8 bit ANSI color escape sequence, like the ones used for 
+ * `colors[]`, into an RGB triplet, using the usual xterm palette.
+ */
+static void
+color_rgb(const char *ansi, uint8_t *rgb)
+{
+	static const uint8_t base[16][3] =
+	{
+		{   0,   0,   0 }, { 205,   0,   0 }, {   0, 205,   0 }, { 205, 205,   0 },
+		{   0,   0, 238 }, { 205,   0, 205 }, {   0, 205, 205 }, { 229, 229, 229 },
+		{ 127, 127, 127 }, { 255,   0,   0 }, {   0, 255,   0 }, { 255, 255,   0 },
+		{  92,  92, 255 }, { 255,   0, 255 }, {   0, 255, 255 }, { 255, 255, 255 }
+	};
+	static const uint8_t cube[6] = { 0, 95, 135, 175, 215, 255 };
+
+	int idx = color_index(ansi);
+
+	if (idx < 16)
+	{
+		memcpy(rgb, base[idx], 3);
+	}
+	else if (idx < 232)
+	{
+		idx -= 16;
+		rgb[0] = cube[idx / 36];
+		rgb[1] = cube[(idx / 6) % 6];
+		rgb[2] = cube[idx % 6];
+	}
+	else
+	{
+		rgb[0] = rgb[1] = rgb[2] = 8 + (idx - 232) * 10;
+	}
+}
+
+/*
+ * Convert the given RGB triplet into Y, Cb and Cr values (BT.601, limited 
+ * range), which is what video encoders assume for Y4M input by default.
+ */
+static void
+color_ycbcr(const uint8_t *rgb, uint8_t *ycc)
+{
+	int r = rgb[0];
+	int g = rgb[1];
+	int b = rgb[2];
+
+	// fixed point, scaled by 256; the offsets keep everything positive
+	ycc[0] = (( 66 * r + 129 * g +  25 * b +  4224) >> 8);
+	ycc[1] = ((-38 * r -  74 * g + 112 * b + 32896) >> 8);
+	ycc[2] = ((112 * r -  94 * g -  18 * b + 32896) >> 8);
+}
+
+/*
+ * Get the atlas tile that represents the given 16 bit matrix value.
+ */
+static uint16_t
+atl_index(uint16_t value)
+{
+	uint8_t state = val_get_state(value);
+	uint8_t ascii = val_get_ascii(value);
+
+	if (state == STATE_NONE || ascii == ' ')
+	{
+		return ATLAS_BLANK;
+	}
+
+	uint8_t color = state == STATE_DROP ? 0 : val_get_tsize(value);
+	return (ascii - ASCII_MIN) * NUM_COLORS + color;
+}
+
+/*
+ * Get a pointer to the RGB pixels of the given atlas tile.
+ */
+static uint8_t *
+atl_tile(atlas_s *atl, uint16_t tile)
+{
+	return atl->rgb + (size_t) tile * atl->cw * atl->ch * 3;
+}
+
+/*
+ * Render the given glyph, in the given color, into its atlas tile. The glyph 
+ * is scaled to the tile size and gets a faint glow around its pixels.
+ */
+static void
+atl_draw(atlas_s *atl, uint8_t glyph, uint8_t color)
+{
+	uint8_t fg[3];
+	uint8_t glow[3];
+	color_rgb(colors[color], fg);
+	for (int i = 0; i < 3; ++i)
+	{
+		glow[i] = atl->bg[i] + (fg[i] - atl->bg[i]) * GLOW_STRENGTH;
+	}
+
+	uint8_t *px = atl_tile(atl, glyph * NUM_COLORS + color);
+	const uint8_t *bits = font[glyph];
+
+	for (int y = 0; y < atl->ch; ++y)
+	{
+		for (int x = 0; x < atl->cw; ++x, px += 3)
+		{
+			// is this pixel part of the glyph, or right next to it?
+			int lit = 0;
+			int near = 0;
+			for (int dy = -1; dy <= 1; ++dy)
+			{
+				for (int dx = -1; dx <= 1; ++dx)
+				{
+					int fx = (x + dx) * FONT_SIZE / atl->cw;
+					int fy = (y + dy) * FONT_SIZE / atl->ch;
+					if (x + dx < 0 || fx >= FONT_SIZE) continue;
+					if (y + dy < 0 || fy >= FONT_SIZE) continue;
+					if ((bits[fy] >> fx) & 1)
+					{
+						near = 1;
+						lit |= (dx == 0 && dy == 0);
+					}
+				}
+			}
+			memcpy(px, lit ? fg : near ? glow : atl->bg, 3);
+		}
+	}
+}
+
+/*
+ * Create or recreate the glyph atlas for the given cell size, in pixels, and 
+ * background color (RGB): every glyph, pre-tinted in every color, plus one 
+ * blank tile.
+ * Returns -1 on error (out of memory), 0 on success.
+ */
+static int
+atl_init(atlas_s *atl, uint16_t cw, uint16_t ch, const uint8_t *bg)
+{
+	atl->rgb = realloc(atl->rgb, (size_t) ATLAS_TILES * cw * ch * 3);
+	if (atl->rgb == NULL)
+	{
+		return -1;
+	}
+
+	atl->cw = cw;
+	atl->ch = ch;
+	memcpy(atl->bg, bg, 3);
+
+	for (int g = 0; g < FONT_GLYPHS; ++g)
+	{
+		for (int c = 0; c < NUM_COLORS; ++c)
+		{
+			atl_draw(atl, g, c);
+		}
+	}
+
+	uint8_t *px = atl_tile(atl, ATLAS_BLANK);
+	for (int i = 0; i < cw * ch; ++i, px += 3)
+	{
+		memcpy(px, atl->bg, 3);
+	}
+
+	return 0;
+}
+
+/*
+ * Free the atlas' memory.
+ */
+static void
+atl_free(atlas_s *atl)
+{
+	free(atl->rgb);
+}
+
+/*
+ * Write the given sixel run, `num` times the char for `bits`, to `out`.
+ */
+static void
+six_run(FILE *out, uint8_t bits, int num)
+{
+	if (num > 3)
+	{
+		fprintf(out, "!%d%c", num, 63 + bits);
+		return;
+	}
+	while (num--)
+	{
+		fputc(63 + bits, out);
+	}
+}
+
+/*
+ * Encode the given atlas tile as sixel image, write it to `out`.
+ */
+static void
+six_encode(atlas_s *atl, uint16_t tile, FILE *out)
+{
+	uint8_t *px = atl_tile(atl, tile);
+	uint8_t  pal[SIXEL_COLORS][3];
+	int      num = 0;
+
+	// find the few distinct colors in this tile
+	for (int i = 0; i < atl->cw * atl->ch && num < SIXEL_COLORS; ++i)
+	{
+		int k = 0;
+		while (k < num && memcmp(pal[k], px + i * 3, 3)) ++k;
+		if (k == num) memcpy(pal[num++], px + i * 3, 3);
+	}
+
+	// transparent background, so we don't touch pixels below the tile
+	fprintf(out, "\x1bP0;1;0q\"1;1;%d;%d", atl->cw, atl->ch);
+	for (int k = 0; k < num; ++k)
+	{
+		fprintf(out, "#%d;2;%d;%d;%d", k, 
+				pal[k][0] * 100 / 255, pal[k][1] * 100 / 255, pal[k][2] * 100 / 255);
+	}
+
+	// one band of six pixel rows at a time, one pass per color
+	for (int y0 = 0; y0 < atl->ch; y0 += 6)
+	{
+		for (int k = 0; k < num; ++k)
+		{
+			fprintf(out, "#%d", k);
+
+			uint8_t last = 0;
+			int     run  = 0;
+			for (int x = 0; x < atl->cw; ++x)
+			{
+				uint8_t bits = 0;
+				for (int y = y0; y < y0 + 6 && y < atl->ch; ++y)
+				{
+					if (!memcmp(pal[k], px + (y * atl->cw + x) * 3, 3))
+					{
+						bits |= 1 << (y - y0);
+					}
+				}
+				if (run && bits != last)
+				{
+					six_run(out, last, run);
+					run = 0;
+				}
+				last = bits;
+				++run;
+			}
+			six_run(out, last, run);
+			fputc('$', out);
+		}
+		fputc('-', out);
+	}
+
+	fputs("\x1b\\", out);
+}
+
+/*
+ * Creates or recreates (resizes) the sixel renderer for the given matrix, 
+ * cell size, in pixels, and background color. The atlas is only rebuilt if 
+ * the cell size or background changed. 
+ * Marks all cells as dirty, so the next frame will be drawn completely.
+ * Returns -1 on error (out of memory), 0 on success.
+ */
+static int
+six_init(sixel_s *six, matrix_s *mat, uint16_t cw, uint16_t ch, const uint8_t *bg)
+{
+	if (six->atlas.cw != cw || six->atlas.ch != ch || memcmp(six->atlas.bg, bg, 3))
+	{
+		if (atl_init(&six->atlas, cw, ch, bg) == -1)
+		{
+			return -1;
+		}
+		for (int i = 0; i < ATLAS_TILES; ++i)
+		{
+			free(six->cache[i]);
+			six->cache[i] = NULL;
+		}
+	}
+
+	size_t size = mat->rows * mat->cols;
+	six->prev = realloc(six->prev, sizeof(*six->prev) * size);
+	if (six->prev == NULL)
+	{
+		return -1;
+	}
+
+	size_t words = (size_t) mat->words * mat->rows;
+	six->shown = realloc(six->shown, sizeof(*six->shown) * words);
+	if (six->shown == NULL)
+	{
+		return -1;
+	}
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		six->prev[i] = SIXEL_DIRTY;
+	}
+
+	// every cell could be showing anything, same layout as the `live` bitmap
+	for (size_t w = 0; w < words; ++w)
+	{
+		int col = w % mat->words * LIVE_BITS;
+		six->shown[w] = mat->cols - col < LIVE_BITS ?
+			((uint64_t) 1 << (mat->cols - col)) - 1 : ~(uint64_t) 0;
+	}
+	return 0;
+}
+
+/*
+ * Print the cell with the given index, if it looks different from last time.
+ * `cur` is the cell the cursor is at, if we know it, SIZE_MAX otherwise.
+ */
+static void
+six_print_cell(sixel_s *six, matrix_s *mat, size_t i, size_t *cur, FILE *out)
+{
+	uint16_t tile = atl_index(mat->data[i]);
+	if (tile == six->prev[i])
+	{
+		return;
+	}
+
+	// encode tiles the first time we need them, then reuse
+	if (six->cache[tile] == NULL)
+	{
+		FILE *enc = open_memstream(&six->cache[tile], &six->clen[tile]);
+		if (enc == NULL)
+		{
+			return;
+		}
+		six_encode(&six->atlas, tile, enc);
+		fclose(enc);
+	}
+
+	if (*cur != i)
+	{
+		fprintf(out, "\x1b[%zu;%zuH", i / mat->cols + 1, i % mat->cols + 1);
+	}
+	fwrite(six->cache[tile], 1, six->clen[tile], out);
+	six->prev[i] = tile;
+
+	// the cursor ends up right of the image, unless that's past the row
+	*cur = (i + 1) % mat->cols ? i + 1 : SIZE_MAX;
+}
+
+/*
+ * Print the matrix as sixel graphics; only cells that look different from 
+ * what they looked like the last time around will be sent to the terminal.
+ * Cells that are empty now and were blank before can't be different, so we 
+ * only look at the ones that are either live now or were shown last time.
+ */
+static void
+six_print(sixel_s *six, matrix_s *mat, FILE *out)
+{
+	size_t cur = SIZE_MAX; // cell the cursor is at, if we know it
+	size_t i   = 0;
+
+	for (int row = 0; row < mat->rows; ++row)
+	{
+		uint64_t *live  = mat_live_bits(mat, row);
+		uint64_t *shown = six->shown + (size_t) row * mat->words;
+
+		for (int word = 0; word < mat->words; ++word)
+		{
+			uint64_t bits = live[word] | shown[word];
+			uint64_t keep = 0;
+
+			for (; bits; bits &= bits - 1)
+			{
+				i = mat_idx(mat, row, word * LIVE_BITS + __builtin_ctzll(bits));
+				six_print_cell(six, mat, i, &cur, out);
+				keep |= six->prev[i] == ATLAS_BLANK ? 0 : bits & -bits;
+			}
+			shown[word] = keep;
+		}
+	}
+}
+
+/*
+ * Free the sixel renderer's memory, including the atlas.
+ */
+static void
+six_free(sixel_s *six)
+{
+	for (int i = 0; i < ATLAS_TILES; ++i)
+	{
+		free(six->cache[i]);
+	}
+	free(six->prev);
+	free(six->shown);
+	atl_free(&six->atlas);
+}
+
+//
+// Functions to publish the matrix to shared memory
+//
+
+/*
+ * Make sure the shared memory segment is big enough for the given matrix, 
+ * growing and remapping it if need be. It never shrinks, so readers that 
+ * mapped it at some bigger size won't run into SIGBUS.
+ * Returns -1 on error, 0 on success.
+ */
+static int
+pub_fit(publisher_s *pub, matrix_s *mat)
+{
+	size_t size = sizeof(shm_frame_s) + sizeof(*mat->data) * mat->rows * mat->cols;
+	if (size <= pub->size)
+	{
+		return 0;
+	}
+
+	if (ftruncate(pub->fd, size) == -1)
+	{
+		return -1;
+	}
+
+	if (pub->shm)
+	{
+		munmap(pub->shm, pub->size);
+	}
+
+	pub->shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, pub->fd, 0);
+	if (pub->shm == MAP_FAILED)
+	{
+		pub->shm = NULL;
+		pub->size = 0;
+		return -1;
+	}
+
+	pub->size = size;
+	pub->shm->size = size;
+	return 0;
+}
+
+/*
+ * Create the shared memory object with the given name and map it. If an 
+ * object with that name exists already, we leave it alone and fail with 
+ * errno set to EEXIST: it might be in use by another instance or program.
+ * Returns -1 on error, 0 on success.
+ */
+static int
+pub_init(publisher_s *pub, const char *name, matrix_s *mat)
+{
+	// POSIX wants the name to start with a slash, so add one if need be
+	snprintf(pub->name, SHM_NAME_MAX, "%s%s", name[0] == '/' ? "" : "/", name);
+
+	pub->fd = shm_open(pub->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (pub->fd == -1)
+	{
+		return -1;
+	}
+
+	if (pub_fit(pub, mat) == -1)
+	{
+		close(pub->fd);
+		shm_unlink(pub->name);
+		return -1;
+	}
+
+	pub->shm->magic     = SHM_MAGIC;
+	pub->shm->version   = SHM_VERSION;
+	pub->shm->cell_size = sizeof(*mat->data);
+	pub->shm->frame     = 0;
+	atomic_store(&pub->shm->seq, 0);
+	return 0;
+}
+
+/*
+ * Copy the current state of the matrix to shared memory. Uses a sequence lock,
+ * so readers never block us, but can tell if they've read a torn frame.
+ * Returns -1 on error (the segment could not be grown), 0 on success.
+ */
+static int
+pub_frame(publisher_s *pub, matrix_s *mat)
+{
+	// in case the matrix has been resized; readers can't see the data 
+	// yet, so they're fine, as long as they keep to the protocol
+	if (pub_fit(pub, mat) == -1)
+	{
+		return -1;
+	}
+
+	shm_frame_s *shm = pub->shm;
+	unsigned seq = atomic_load_explicit(&shm->seq, memory_order_relaxed);
+
+	// odd sequence number: we're writing, readers have to wait
+	atomic_store_explicit(&shm->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	shm->cols = mat->cols;
+	shm->rows = mat->rows;
+	shm->frame += 1;
+	memcpy(shm->data, mat->data, sizeof(*mat->data) * mat->rows * mat->cols);
+
+	// even sequence number: all done, readers can go ahead
+	atomic_store_explicit(&shm->seq, seq + 2, memory_order_release);
+	return 0;
+}
+
+/*
+ * Unmap and remove the shared memory object (which we created ourselves).
+ */
+static void
+pub_free(publisher_s *pub)
+{
+	if (pub->shm)
+	{
+		munmap(pub->shm, pub->size);
+	}
+	close(pub->fd);
+	shm_unlink(pub->name);
+}
+
+//
+// Functions to measure how we're doing
+//
+
+/*
+ * Get the current value of the given clock, in nanoseconds.
+ */
+static uint64_t
+time_ns(clockid_t clock)
+{
+	struct timespec ts = { 0 };
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * Print the collected statistics to `where`. With a `gov`, the effective 
+ * settings are printed as well; `target` is the frame rate it asked for.
+ */
+static void
+stats_print(stats_s *stats, matrix_s *mat, governor_s *gov, float error_ratio, 
+		float target, FILE *where)
+{
+	double frames = stats->frames ? stats->frames : 1;
+	double secs   = stats->ns_total / (double) NS_PER_SEC;
+
+	fprintf(where, "frames:  %"PRIu64"\n", stats->frames);
+	fprintf(where, "matrix:  %"PRIu16" x %"PRIu16" cells\n", mat->cols, mat->rows);
+	fprintf(where, "time:    %.3f s (%.1f fps)\n", secs, stats->frames / secs);
+	if (stats->ns_print)
+	{
+		fprintf(where, "render:  %.1f us/frame\n", stats->ns_print  / frames / 1000.0);
+		fprintf(where, "glitch:  %.1f us/frame\n", stats->ns_glitch / frames / 1000.0);
+		fprintf(where, "update:  %.1f us/frame\n", stats->ns_update / frames / 1000.0);
+		fprintf(where, "output:  %.1f bytes/frame\n", stats->bytes / frames);
+	}
+	if (gov)
+	{
+		fprintf(where, "budget:  %.1f %% CPU, using %.1f %% (%.1f us/frame)\n",
+				gov->budget, gov->usage, gov->cost);
+		fprintf(where, "load:    %.2f\n", gov->load);
+		fprintf(where, "drops:   %.4f\n", mat->drop_ratio);
+		fprintf(where, "errors:  %.4f\n", error_ratio);
+		fprintf(where, "rate:    %.1f fps (target %.1f fps)\n", 
+				stats->frames / secs, target);
+	}
+}
+
+/*
+ * Set up the CPU budget governor; `budget` is in percent of one CPU core.
+ */
+static void
+gov_init(governor_s *gov, uint8_t budget)
+{
+	gov->budget  = budget;
+	gov->load    = 1.0;
+	gov->ns_cpu  = time_ns(CLOCK_PROCESS_CPUTIME_ID);
+	gov->ns_wall = time_ns(CLOCK_MONOTONIC);
+}
+
+/*
+ * Measure how much CPU time we've been using since the last call and nudge 
+ * the load factor towards a value that keeps us within budget. The load is 
+ * only changed by GOV_STEP at a time, so the adjustments aren't noticeable.
+ * Does nothing unless at least GOV_INTERVAL seconds have passed.
+ * Returns 1 if the load factor has changed, otherwise 0.
+ */
+static int
+gov_adjust(governor_s *gov, uint64_t frames)
+{
+	uint64_t ns_wall = time_ns(CLOCK_MONOTONIC);
+	if (ns_wall - gov->ns_wall < GOV_INTERVAL * NS_PER_SEC)
+	{
+		return 0;
+	}
+	uint64_t ns_cpu = time_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+	// CPU usage and cost per frame since the last adjustment
+	float usage = 100.0 * (ns_cpu - gov->ns_cpu) / (ns_wall - gov->ns_wall);
+	float cost  = frames > gov->frames ? 
+		(ns_cpu - gov->ns_cpu) / 1000.0 / (frames - gov->frames) : gov->cost;
+
+	// smooth things out, so a single hiccup doesn't throw us off
+	gov->usage = gov->usage ? gov->usage + GOV_SMOOTHING * (usage - gov->usage) : usage;
+	gov->cost  = gov->cost  ? gov->cost  + GOV_SMOOTHING * (cost  - gov->cost)  : cost;
+
+	gov->ns_cpu  = ns_cpu;
+	gov->ns_wall = ns_wall;
+	gov->frames  = frames;
+
+	// close enough, leave it be, lest we oscillate around the target
+	float off = gov->usage - gov->budget;
+	if (off > -GOV_TOLERANCE * gov->budget && off < GOV_TOLERANCE * gov->budget)
+	{
+		return 0;
+	}
+
+	// CPU usage scales roughly linearly with the load factor
+	float load = gov->usage > 0 ? gov->load * gov->budget / gov->usage : 1.0;
+	if (load > gov->load + GOV_STEP) load = gov->load + GOV_STEP;
+	if (load < gov->load - GOV_STEP) load = gov->load - GOV_STEP;
+	if (load > 1.0)                  load = 1.0;
+	if (load < GOV_LOAD_MIN)         load = GOV_LOAD_MIN;
+
+	if (load == gov->load)
+	{
+		return 0;
+	}
+	gov->load = load;
+	return 1;
+}
+
+//
+// Functions to emulate a (very) minimal terminal, to see what our output 
+// costs on the other end and whether it actually shows what it should
+//
+
+/*
+ * Creates or recreates (resizes) the emulated screen; the screen will be blank
+ * and the cursor at the top left. Returns -1 on error (out of memory), 0 on 
+ * success. Statistics are kept, so they add up over resizes.
+ */
+static int
+vt_init(vt_s *vt, uint16_t rows, uint16_t cols)
+{
+	vt->cells = realloc(vt->cells, sizeof(*vt->cells) * rows * cols);
+	if (vt->cells == NULL)
+	{
+		return -1;
+	}
+
+	vt->rows = rows;
+	vt->cols = cols;
+	vt->row  = 0;
+	vt->col  = 0;
+	vt->wrap = 0;
+	vt->state = VT_GROUND;
+	vt->pen = (vt_cell_s) { ' ', 0, VT_COLOR_DEFAULT, VT_COLOR_DEFAULT };
+
+	for (int i = 0; i < rows * cols; ++i)
+	{
+		vt->cells[i] = vt->pen;
+	}
+	return 0;
+}
+
+/*
+ * Free the emulated screen.
+ */
+static void
+vt_free(vt_s *vt)
+{
+	free(vt->cells);
+}
+
+/*
+ * Scroll the screen up by one row, blanking the bottom row.
+ */
+static void
+vt_scroll(vt_s *vt)
+{
+	memmove(vt->cells, vt->cells + vt->cols, 
+			sizeof(*vt->cells) * (vt->rows - 1) * vt->cols);
+	for (int c = 0; c < vt->cols; ++c)
+	{
+		vt->cells[(vt->rows - 1) * vt->cols + c] = (vt_cell_s) 
+			{ ' ', 0, VT_COLOR_DEFAULT, vt->pen.bg };
+	}
+	vt->scrolls += 1;
+}
+
+/*
+ * Move to the next line, scrolling if we're at the bottom already.
+ */
+static void
+vt_newline(vt_s *vt)
+{
+	if (vt->row == vt->rows - 1)
+	{
+		vt_scroll(vt);
+		return;
+	}
+	vt->row += 1;
+}
+
+/*
+ * Blank the cells in the range [from, to), in the current background color.
+ */
+static void
+vt_erase(vt_s *vt, int from, int to)
+{
+	for (int i = from; i < to; ++i)
+	{
+		vt->cells[i] = (vt_cell_s) { ' ', 0, VT_COLOR_DEFAULT, vt->pen.bg };
+	}
+}
+
+/*
+ * Put a printable char at the cursor position. Like most terminals, we wrap 
+ * lazily: writing the last column only wraps with the next printable char.
+ */
+static void
+vt_print(vt_s *vt, uint8_t c)
+{
+	if (vt->wrap)
+	{
+		vt->col  = 0;
+		vt->wrap = 0;
+		vt_newline(vt);
+	}
+
+	vt_cell_s  cell = vt->pen;
+	vt_cell_s *dest = &vt->cells[vt->row * vt->cols + vt->col];
+	cell.glyph = c;
+
+	if (memcmp(dest, &cell, sizeof(cell)) == 0)
+	{
+		vt->same += 1;
+	}
+	else
+	{
+		vt->changed += 1;
+		*dest = cell;
+	}
+	vt->chars += 1;
+
+	if (vt->col == vt->cols - 1)
+	{
+		vt->wrap = 1;
+		return;
+	}
+	vt->col += 1;
+}
+
+/*
+ * Apply SGR (select graphic rendition) parameters to the pen.
+ */
+static void
+vt_sgr(vt_s *vt)
+{
+	if (vt->num == 0)
+	{
+		vt->num = 1;
+		vt->par[0] = 0;
+	}
+
+	for (int i = 0; i < vt->num; ++i)
+	{
+		int p = vt->par[i];
+		if (p == 0)
+		{
+			vt->pen.attr = 0;
+			vt->pen.fg = VT_COLOR_DEFAULT;
+			vt->pen.bg = VT_COLOR_DEFAULT;
+		}
+		else if (p == 1 || p == 2)
+		{
+			vt->pen.attr |= p;
+		}
+		else if (p == 22)
+		{
+			vt->pen.attr = 0;
+		}
+		else if (p >= 30 && p <= 37) vt->pen.fg = p - 30;
+		else if (p >= 90 && p <= 97) vt->pen.fg = p - 90 + 8;
+		else if (p >= 40 && p <= 47) vt->pen.bg = p - 40;
+		else if (p == 39) vt->pen.fg = VT_COLOR_DEFAULT;
+		else if (p == 49) vt->pen.bg = VT_COLOR_DEFAULT;
+		else if ((p == 38 || p == 48) && i + 2 < vt->num && vt->par[i+1] == 5)
+		{
+			*(p == 38 ? &vt->pen.fg : &vt->pen.bg) = vt->par[i+2];
+			i += 2;
+		}
+	}
+}
+
+/*
+ * Act on a complete CSI sequence, where `final` is its final byte.
+ */
+static void
+vt_csi(vt_s *vt, uint8_t final)
+{
+	int p0 = vt->num > 0 ? vt->par[0] : 0;
+	int p1 = vt->num > 1 ? vt->par[1] : 0;
+	int n  = p0 ? p0 : 1;
+
+	// private (`?`) and intermediate (`$` etc) sequences don't touch the grid
+	if (vt->priv || vt->inter)
+	{
+		vt->csi_other += 1;
+		return;
+	}
+
+	switch (final)
+	{
+		case 'm':
+			vt->sgr += 1;
+			vt_sgr(vt);
+			return;
+		case 'H':
+		case 'f':
+			vt->row = (p0 ? p0 : 1) - 1;
+			vt->col = (p1 ? p1 : 1) - 1;
+			break;
+		case 'A': vt->row -= n < vt->row ? n : vt->row; break;
+		case 'B': vt->row += n; break;
+		case 'C': vt->col += n; break;
+		case 'D': vt->col -= n < vt->col ? n : vt->col; break;
+		case 'G': vt->col = n - 1; break;
+		case 'd': vt->row = n - 1; break;
+		case 'J':
+		{
+			int cur = vt->row * vt->cols + vt->col;
+			int end = vt->rows * vt->cols;
+			vt_erase(vt, p0 == 0 ? cur : 0, p0 == 1 ? cur + 1 : end);
+			vt->csi_other += 1;
+			return;
+		}
+		case 'K':
+		{
+			int row = vt->row * vt->cols;
+			int cur = row + vt->col;
+			vt_erase(vt, p0 == 0 ? cur : row, p0 == 1 ? cur + 1 : row + vt->cols);
+			vt->csi_other += 1;
+			return;
+		}
+		default:
+			vt->csi_other += 1;
+			return;
+	}
+
+	// if we get here, the cursor has been moved
+	if (vt->row >= vt->rows) vt->row = vt->rows - 1;
+	if (vt->col >= vt->cols) vt->col = vt->cols - 1;
+	vt->wrap = 0;
+	vt->moves += 1;
+}
+
+/*
+ * Feed `len` bytes of output to the emulated terminal.
+ */
+static void
+vt_feed(vt_s *vt, const char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		uint8_t c = buf[i];
+		vt->bytes += 1;
+
+		switch (vt->state)
+		{
+			case VT_GROUND:
+				if (c == 0x1b)     vt->state = VT_ESC;
+				else if (c >= 32)  vt_print(vt, c);
+				else if (c == '\n') vt_newline(vt);
+				else if (c == '\r') { vt->col = 0; vt->wrap = 0; }
+				break;
+			case VT_ESC:
+				if (c == '[')
+				{
+					vt->state = VT_CSI;
+					vt->num   = 0;
+					vt->par[0] = 0;
+					vt->priv  = 0;
+					vt->inter = 0;
+				}
+				else if (c == 'P' || c == ']' || c == '_' || c == '^' || c == 'X')
+				{
+					vt->state = VT_STRING;
+					vt->strings += 1;
+				}
+				else
+				{
+					vt->state = VT_GROUND;
+					vt->esc_other += 1;
+				}
+				break;
+			case VT_CSI:
+				if (c >= '0' && c <= '9')
+				{
+					if (vt->num == 0) vt->num = 1;
+					if (vt->num <= VT_MAX_PARAMS)
+					{
+						int *p = &vt->par[vt->num - 1];
+						*p = *p * 10 + (c - '0');
+					}
+				}
+				else if (c == ';')
+				{
+					if (vt->num == 0) vt->num = 1;
+					if (vt->num < VT_MAX_PARAMS) vt->par[vt->num] = 0;
+					vt->num += 1;
+				}
+				else if (c >= 0x3c && c <= 0x3f) vt->priv = c;
+				else if (c >= 0x20 && c <= 0x2f) vt->inter = c;
+				else if (c >= 0x40 && c <= 0x7e)
+				{
+					if (vt->num > VT_MAX_PARAMS) vt->num = VT_MAX_PARAMS;
+					vt_csi(vt, c);
+					vt->state = VT_GROUND;
+				}
+				break;
+			case VT_STRING:
+				// strings (DCS, OSC, ...) end with ST (ESC \) or, for OSC, BEL
+				if (c == 0x1b)     vt->state = VT_STRING_ESC;
+				else if (c == 0x07) vt->state = VT_GROUND;
+				break;
+			case VT_STRING_ESC:
+				vt->state = c == '\\' ? VT_GROUND : VT_STRING;
+				break;
+		}
+	}
+}
+
+/*
+ * Compare the emulated screen against the matrix; every cell needs to show 
+ * the right char in the right color (the color of empty cells doesn't 
+ * matter). Returns the number of cells that are off.
+ */
+static size_t
+vt_check(vt_s *vt, matrix_s *mat)
+{
+	if (vt->rows != mat->rows || vt->cols != mat->cols)
+	{
+		return mat->rows * mat->cols;
+	}
+
+	size_t off = 0;
+	for (size_t i = 0; i < mat->rows * mat->cols; ++i)
+	{
+		uint16_t value = mat->data[i];
+		uint8_t  state = val_get_state(value);
+		vt_cell_s *cell = &vt->cells[i];
+
+		if (state == STATE_NONE)
+		{
+			off += cell->glyph != ' ';
+			continue;
+		}
+
+		int color = color_index(colors[state == STATE_DROP ? 0 : val_get_tsize(value)]);
+		off += cell->glyph != val_get_ascii(value) || cell->fg != color;
+	}
+	return off;
+}
+
+/*
+ * Print what the emulated terminal had to do, per frame, to `where`.
+ */
+static void
+vt_report(vt_s *vt, uint64_t frames, int checked, FILE *where)
+{
+	double f = frames ? frames : 1;
+
+	fprintf(where, "vt:      %.1f us/frame (parsing and checking)\n", vt->ns_spent / f / 1000.0);
+	fprintf(where, "parsed:  %.1f bytes/frame\n", vt->bytes / f);
+	fprintf(where, "chars:   %.1f printed/frame\n", vt->chars / f);
+	fprintf(where, "changed: %.1f cells/frame\n", vt->changed / f);
+	fprintf(where, "same:    %.1f cells/frame (overwritten with same content)\n", vt->same / f);
+	fprintf(where, "sgr:     %.1f sequences/frame\n", vt->sgr / f);
+	fprintf(where, "moves:   %.1f cursor moves/frame\n", vt->moves / f);
+	fprintf(where, "csi:     %.1f other sequences/frame\n", vt->csi_other / f);
+	fprintf(where, "strings: %.1f DCS/OSC/APC/.../frame\n", vt->strings / f);
+	fprintf(where, "escapes: %.1f other sequences/frame\n", vt->esc_other / f);
+	fprintf(where, "scrolls: %.1f lines/frame\n", vt->scrolls / f);
+	if (checked)
+	{
+		fprintf(where, "screen:  %"PRIu64" cells off in %"PRIu64" of %"PRIu64" frames\n", 
+				vt->off_cells, vt->off_frames, frames);
+	}
+}
+
+/*
+ * Run the given number of frames as fast as we can, rendering into memory 
+ * instead of the terminal, then print some statistics to stdout. If `six` 
+ * isn't NULL, we render sixel graphics, otherwise text. If `vt` isn't NULL, 
+ * all output is also fed to the emulated terminal, which checks that the 
+ * screen matches the matrix after every frame (for text output).
+ * Returns -1 on error (out of memory), 0 on success.
+ */
+static int
+bench(matrix_s *mat, sixel_s *six, vt_s *vt, float error_ratio, uint32_t frames)
+{
+	char  *buf = NULL;
+	size_t len = 0;
+	FILE  *out = open_memstream(&buf, &len);
+	if (out == NULL)
+	{
+		return -1;
+	}
 
-		// null the current cell
-		mat_set_state(mat, row, col, STATE_NONE);
-		mat_set_tsize(mat, row, col, 0);
+	stats_s stats = { 0 };
+	mat_rain(mat);
 
-		// keep track of the tail length of the last seen drop
-		if (state == STATE_DROP)
+	uint64_t t0 = time_ns(CLOCK_MONOTONIC);
+	for (uint32_t i = 0; i < frames; ++i)
+	{
+		uint64_t t1 = time_ns(CLOCK_MONOTONIC);
+		out_puts(out, ANSI_CURSOR_RESET);
+		if (six) six_print(six, mat, out);
+		else     mat_print(mat, out);
+		uint64_t t2 = time_ns(CLOCK_MONOTONIC);
+
+		// have the emulated terminal look at the frame before it changes;
+		// that time is accounted for separately, it's not part of rendering
+		if (vt)
 		{
-			// remember the tail size to draw for this drop
-			tail_size = tsize;
-			tail_seen = 0;
+			fflush(out);
+			vt_feed(vt, buf, ftell(out));
+			size_t off = six ? 0 : vt_check(vt, mat);
+			vt->off_cells  += off;
+			vt->off_frames += off > 0;
 		}
-		else if (state == STATE_TAIL && tail_size > 0)
+		uint64_t t3 = time_ns(CLOCK_MONOTONIC);
+
+		mat_glitch(mat, error_ratio);
+		uint64_t t4 = time_ns(CLOCK_MONOTONIC);
+		mat_update(mat);
+		uint64_t t5 = time_ns(CLOCK_MONOTONIC);
+
+		stats.ns_print  += t2 - t1;
+		stats.ns_glitch += t4 - t3;
+		stats.ns_update += t5 - t4;
+		if (vt) vt->ns_spent += t3 - t2;
+
+		// count this frame's bytes, then start over for the next one
+		stats.bytes += ftell(out);
+		fseek(out, 0, SEEK_SET);
+		stats.frames += 1;
+	}
+	stats.ns_total = time_ns(CLOCK_MONOTONIC) - t0;
+
+	fclose(out);
+	free(buf);
+
+	stats_print(&stats, mat, NULL, error_ratio, 0, stdout);
+	if (vt)
+	{
+		vt_report(vt, stats.frames, six == NULL, stdout);
+	}
+	return 0;
+}
+
+//
+// Functions to export the matrix as video, without a terminal
+//
+
+/*
+ * Prepare the atlas tiles the way they end up in the frames: for PPM, that's
+ * just the RGB atlas; for Y4M, each tile becomes a Y, a Cb and a Cr plane.
+ * Returns -1 on error (out of memory), 0 on success.
+ */
+static int
+vid_tiles(video_s *vid)
+{
+	if (vid->format == VIDEO_PPM)
+	{
+		vid->tiles = vid->atlas.rgb;
+		return 0;
+	}
+
+	size_t area = (size_t) vid->atlas.cw * vid->atlas.ch;
+	vid->tiles = malloc(ATLAS_TILES * area * 3);
+	if (vid->tiles == NULL)
+	{
+		return -1;
+	}
+
+	for (int t = 0; t < ATLAS_TILES; ++t)
+	{
+		uint8_t *rgb = atl_tile(&vid->atlas, t);
+		uint8_t *out = vid->tiles + t * area * 3;
+		uint8_t  ycc[3];
+
+		for (size_t i = 0; i < area; ++i)
 		{
-			// keep track of how many tail cells we've seen
-			++tail_seen;
+			color_ycbcr(rgb + i * 3, ycc);
+			out[i]            = ycc[0];
+			out[i + area]     = ycc[1];
+			out[i + area * 2] = ycc[2];
 		}
 	}
+	return 0;
+}
+
+/*
+ * Rasterize the frame in the given slot: look up the atlas tile of each cell,
+ * then copy the tiles' pixels into the frame, one pixel row at a time. Cells 
+ * that stick out past the right or bottom edge of the frame are cut off.
+ */
+static void
+vid_raster(video_s *vid, int slot)
+{
+	uint16_t *cells  = vid->cells  + (size_t) slot * vid->cols * vid->rows;
+	uint8_t  *pixels = vid->pixels + (size_t) slot * vid->size;
 
-	// if the top-most cell wasn't empty, we might have to add a tail cell
-	if (state != STATE_NONE && tail_seen < tail_size)
+	for (size_t i = 0; i < (size_t) vid->cols * vid->rows; ++i)
 	{
-		mat_put_cell_tail(mat, 0, col, tail_size, tail_seen + 1); 
+		cells[i] = atl_index(cells[i]);
 	}
 
-	return dropped;
+	// Y4M has three planes of one byte per pixel, PPM one of three bytes
+	int    planes = vid->format == VIDEO_Y4M ? 3 : 1;
+	int    bpp    = vid->format == VIDEO_Y4M ? 1 : 3;
+	int    cw     = vid->atlas.cw;
+	int    ch     = vid->atlas.ch;
+	size_t tsize  = (size_t) cw * ch * bpp;
+
+	for (int p = 0; p < planes; ++p)
+	{
+		for (int y = 0; y < vid->height; ++y)
+		{
+			uint16_t *line = cells + (size_t) (y / ch) * vid->cols;
+			uint8_t  *dst  = pixels + (size_t) (p * vid->height + y) * vid->width * bpp;
+			size_t    skip = (size_t) p * tsize + (y % ch) * cw * bpp;
+
+			for (int col = 0, x = 0; x < vid->width; ++col, x += cw)
+			{
+				int w = x + cw > vid->width ? vid->width - x : cw;
+				memcpy(dst + x * bpp, 
+						vid->tiles + line[col] * tsize * planes + skip, w * bpp);
+			}
+		}
+	}
 }
 
 /*
- * Update the matrix by moving all drops down one cell and potentially 
- * adding new drops at the top of the matrix.
+ * Rasterizer thread: takes queued frames, in order, and rasterizes them, 
+ * until told to quit and there's nothing left to do.
  */
-static void 
-mat_update(matrix_s *mat)
+static void *
+vid_work(void *arg)
 {
-	// move each column down one cell, possibly dropping some drops
-	for (int col = 0; col < mat->cols; ++col)
+	video_s *vid = arg;
+	int slot = 0;
+
+	pthread_mutex_lock(&vid->lock);
+	while (1)
 	{
-		mat->drop_count -= mat_mov_col(mat, col);
+		while (vid->claimed == vid->queued && !vid->quit)
+		{
+			pthread_cond_wait(&vid->cond, &vid->lock);
+		}
+		if (vid->claimed == vid->queued)
+		{
+			break;
+		}
+		slot = vid->claimed++ % vid->slots;
+		pthread_mutex_unlock(&vid->lock);
+
+		vid_raster(vid, slot);
+
+		pthread_mutex_lock(&vid->lock);
+		vid->done[slot] = 1;
+		pthread_cond_broadcast(&vid->cond);
 	}
-	
-	// add new drops at the top, trying to get to the desired drop count
-	int drops_desired = (mat->cols * mat->rows) * mat->drop_ratio;
-	int drops_missing = drops_desired - mat->drop_count; 
-	int drops_to_add  = ceil(drops_missing / (float) mat->rows);
+	pthread_mutex_unlock(&vid->lock);
+	return NULL;
+}
 
-	for (int i = 0; i <= drops_to_add; ++i)
+/*
+ * Write the (rasterized) frame in the given slot to `out`, header included.
+ * Returns -1 on error (write failed), 0 on success.
+ */
+static int
+vid_write(video_s *vid, int slot, FILE *out)
+{
+	if (vid->format == VIDEO_Y4M)
 	{
-		mat_add_drop(mat, 0, rand_int(0, mat->cols - 1), 
-				rand_int(TSIZE_MIN, TSIZE_MAX));
+		fputs("FRAME\n", out);
+	}
+	else
+	{
+		fprintf(out, "P6\n%"PRIu16" %"PRIu16"\n255\n", vid->width, vid->height);
 	}
+
+	size_t w = fwrite(vid->pixels + (size_t) slot * vid->size, 1, vid->size, out);
+	return w == vid->size ? 0 : -1;
 }
 
 /*
- * Fill the entire matrix with random characters, setting all cells to state
- * STATE_NONE in the process.
+ * Set up the video export for the given matrix, frame size, cell size (in 
+ * pixels) and background color and start `threads` rasterizer threads. Each thread gets one slot,
+ * plus two more, so that there's always something to write and to work on.
+ * Returns -1 on error (out of memory, no threads), 0 on success.
  */
-static void
-mat_fill(matrix_s *mat)
+static int
+vid_init(video_s *vid, matrix_s *mat, uint8_t format, uint16_t width, 
+		uint16_t height, uint16_t cw, uint16_t ch, const uint8_t *bg, int threads)
 {
-	for (int r = 0; r < mat->rows; ++r)
+	vid->format = format;
+	vid->width  = width;
+	vid->height = height;
+	vid->cols   = mat->cols;
+	vid->rows   = mat->rows;
+	vid->size   = (size_t) width * height * 3;
+	vid->slots  = threads + 2;
+
+	pthread_mutex_init(&vid->lock, NULL);
+	pthread_cond_init(&vid->cond, NULL);
+
+	if (atl_init(&vid->atlas, cw, ch, bg) == -1 || vid_tiles(vid) == -1)
 	{
-		for (int c = 0; c < mat->cols; ++c)
+		return -1;
+	}
+
+	vid->cells   = malloc(sizeof(*vid->cells) * vid->cols * vid->rows * vid->slots);
+	vid->pixels  = malloc(vid->size * vid->slots);
+	vid->done    = calloc(vid->slots, sizeof(*vid->done));
+	vid->workers = malloc(sizeof(*vid->workers) * threads);
+	if (!vid->cells || !vid->pixels || !vid->done || !vid->workers)
+	{
+		return -1;
+	}
+
+	for (; vid->threads < threads; ++vid->threads)
+	{
+		if (pthread_create(&vid->workers[vid->threads], NULL, vid_work, vid))
 		{
-			mat_set_state(mat, r, c, STATE_NONE);
-			mat_set_ascii(mat, r, c, rand_ascii());
+			break;
 		}
 	}
+	return vid->threads ? 0 : -1;
 }
 
 /*
- * Creates or recreates (resizes) the given matrix.
- * Returns -1 on error (out of memory), 0 on success.
+ * Export the given number of frames as video to stdout, as fast as we can: 
+ * we take a snapshot of the matrix, hand it to the rasterizer threads, move 
+ * on to the next frame, and write the finished frames in order as they come 
+ * in. Prints some statistics, including the frame rate we achieved, to stderr.
+ * `fps` is the frame rate of the video, it only ends up in the Y4M header.
+ * Returns -1 on error (write failed), 0 on success.
  */
 static int
-mat_init(matrix_s *mat, uint16_t rows, uint16_t cols, float drop_ratio)
+vid_run(video_s *vid, matrix_s *mat, float error_ratio, float fps, uint32_t frames)
 {
-	mat->data = realloc(mat->data, sizeof(mat->data) * rows * cols);
-	if (mat->data == NULL)
+	size_t cells = (size_t) vid->cols * vid->rows;
+	int    slot  = 0;
+	int    err   = 0;
+
+	if (vid->format == VIDEO_Y4M)
 	{
-		return -1;
+		fprintf(stdout, "YUV4MPEG2 W%"PRIu16" H%"PRIu16" F%u:1000 Ip A1:1 C444\n",
+				vid->width, vid->height, (unsigned) (fps * 1000 + 0.5));
 	}
-	
-	mat->rows = rows;
-	mat->cols = cols;
 
-	mat->drop_count = 0;
-	mat->drop_ratio = drop_ratio;
-	
-	return 0;
+	stats_s stats = { 0 };
+	mat_rain(mat);
+
+	uint64_t t0 = time_ns(CLOCK_MONOTONIC);
+	running = 1;
+
+	pthread_mutex_lock(&vid->lock);
+	while (vid->written < frames && running && !err)
+	{
+		// hand the next frame to the rasterizers, if there's a free slot
+		if (vid->queued < frames && vid->queued - vid->written < vid->slots)
+		{
+			slot = vid->queued % vid->slots;
+			pthread_mutex_unlock(&vid->lock);
+
+			memcpy(vid->cells + slot * cells, mat->data, sizeof(*mat->data) * cells);
+			mat_glitch(mat, error_ratio);
+			mat_update(mat);
+
+			pthread_mutex_lock(&vid->lock);
+			vid->queued += 1;
+			pthread_cond_broadcast(&vid->cond);
+			continue;
+		}
+
+		// write the oldest frame, as soon as it is done
+		slot = vid->written % vid->slots;
+		if (vid->done[slot])
+		{
+			pthread_mutex_unlock(&vid->lock);
+			err = vid_write(vid, slot, stdout) == -1;
+			pthread_mutex_lock(&vid->lock);
+			vid->done[slot] = 0;
+			vid->written += 1;
+			continue;
+		}
+
+		pthread_cond_wait(&vid->cond, &vid->lock);
+	}
+	stats.frames = vid->written;
+	pthread_mutex_unlock(&vid->lock);
+
+	err = fflush(stdout) == EOF || err;
+	stats.ns_total = time_ns(CLOCK_MONOTONIC) - t0;
+
+	double secs = stats.ns_total / (double) NS_PER_SEC;
+	stats_print(&stats, mat, NULL, error_ratio, 0, stderr);
+	fprintf(stderr, "video:   %"PRIu16" x %"PRIu16" pixels, %.1f MB/s\n",
+			vid->width, vid->height, stats.frames * vid->size / secs / (1024 * 1024));
+	fprintf(stderr, "threads: %d\n", vid->threads);
+	return err ? -1 : 0;
 }
 
 /*
- * Free ALL the memory \o/
+ * Stop the rasterizer threads and free the video export's memory.
  */
-void
-mat_free(matrix_s *mat)
+static void
+vid_free(video_s *vid)
 {
-	free(mat->data);
+	pthread_mutex_lock(&vid->lock);
+	vid->quit = 1;
+	pthread_cond_broadcast(&vid->cond);
+	pthread_mutex_unlock(&vid->lock);
+
+	for (int i = 0; i < vid->threads; ++i)
+	{
+		pthread_join(vid->workers[i], NULL);
+	}
+
+	pthread_cond_destroy(&vid->cond);
+	pthread_mutex_destroy(&vid->lock);
+
+	if (vid->tiles != vid->atlas.rgb)
+	{
+		free(vid->tiles);
+	}
+	free(vid->cells);
+	free(vid->pixels);
+	free(vid->done);
+	free(vid->workers);
+	atl_free(&vid->atlas);
 }
 
+#endif
+
 /*
  * Try to figure out the terminal size, in character cells, and return that 
  * info in the given winsize structure. Returns 0 on succes, -1 on error.
@@ -668,6 +2907,26 @@ cli_wsize(struct winsize *ws)
 	return ioctl(STDOUT_FILENO, TIOCGWINSZ, ws);
 }
 
+#ifndef FAKESTEAK_TINY
+/*
+ * Figure out the size of a terminal cell, in pixels, from the given winsize 
+ * structure. Not all terminals report their size in pixels, so we might have 
+ * to fall back to some sensible defaults instead.
+ */
+static void
+cli_csize(struct winsize *ws, uint16_t *cw, uint16_t *ch)
+{
+	if (ws->ws_xpixel == 0 || ws->ws_ypixel == 0)
+	{
+		*cw = CELL_W_DEF;
+		*ch = CELL_H_DEF;
+		return;
+	}
+	*cw = ws->ws_xpixel / ws->ws_col;
+	*ch = ws->ws_ypixel / ws->ws_row;
+}
+#endif
+
 /*
  * Turn echoing of keyboard input on/off.
  */
@@ -683,13 +2942,96 @@ cli_echo(int on)
 	return tcsetattr(STDIN_FILENO, TCSAFLUSH, &ta);
 }
 
+/*
+ * Find out if the terminal supports synchronized updates (DEC private mode 
+ * 2026), which allow us to have the terminal draw each frame in one go.
+ * We ask via DECRQM and send a DA1 query right after; every terminal answers 
+ * the latter, so we know we can stop waiting once we see that reply, even if 
+ * the terminal ignored the first query. Returns 1 if supported, 0 otherwise.
+ */
+static int
+cli_sync_query()
+{
+	if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO))
+	{
+		return 0;
+	}
+
+	// we need non-canonical mode to read the reply, which has no newline
+	struct termios ta_old;
+	if (tcgetattr(STDIN_FILENO, &ta_old) != 0)
+	{
+		return 0;
+	}
+	struct termios ta_raw = ta_old;
+	ta_raw.c_lflag &= ~(ICANON | ECHO);
+	ta_raw.c_cc[VMIN]  = 0;
+	ta_raw.c_cc[VTIME] = 0;
+	if (tcsetattr(STDIN_FILENO, TCSANOW, &ta_raw) != 0)
+	{
+		return 0;
+	}
+
+	out_puts(OUT_STDOUT, ANSI_SYNC_QUERY);
+	out_puts(OUT_STDOUT, ANSI_DA1_QUERY);
+	out_flush(OUT_STDOUT);
+
+	// read until we've seen the DA1 reply, which ends in 'c', or time out
+	char reply[SYNC_REPLY_SIZE] = { 0 };
+	size_t len = 0;
+	struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+	while (len < sizeof(reply) - 1 && poll(&pfd, 1, SYNC_QUERY_TIMEOUT) > 0)
+	{
+		ssize_t r = read(STDIN_FILENO, reply + len, sizeof(reply) - 1 - len);
+		if (r <= 0)
+		{
+			break;
+		}
+		len += r;
+		reply[len] = '\0';
+		if (strstr(reply, "\x1b[?") && reply[len-1] == 'c')
+		{
+			break;
+		}
+	}
+
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &ta_old);
+
+	// DECRPM reply looks like `ESC [ ? 2026 ; Ps $ y`, where Ps is 1 (set), 
+	// 2 (reset) or 3 (permanently set) if the mode is supported at all
+	char *rpm = strstr(reply, "\x1b[?2026;");
+	if (rpm == NULL)
+	{
+		return 0;
+	}
+	char ps = rpm[sizeof("\x1b[?2026;") - 1];
+	return (ps == '1' || ps == '2' || ps == '3');
+}
+
 /*
  * Prepare the terminal for the next paint iteration.
  */
 static void
-cli_clear()
+cli_clear(int sync)
+{
+	if (sync)
+	{
+		out_puts(OUT_STDOUT, ANSI_SYNC_BEGIN);
+	}
+	out_puts(OUT_STDOUT, ANSI_CURSOR_RESET);
+}
+
+/*
+ * Finish the current paint iteration and hand it to the terminal.
+ */
+static void
+cli_flush(int sync)
 {
-	fputs(ANSI_CURSOR_RESET, stdout);
+	if (sync)
+	{
+		out_puts(OUT_STDOUT, ANSI_SYNC_END);
+	}
+	out_flush(OUT_STDOUT);
 }
 
 /*
@@ -698,35 +3040,46 @@ cli_clear()
 static void
 cli_setup(options_s *opts)
 {
-	fputs(ANSI_HIDE_CURSOR, stdout);
-	fputs(ANSI_FONT_BOLD, stdout);
+	out_puts(OUT_STDOUT, ANSI_HIDE_CURSOR);
+	out_puts(OUT_STDOUT, ANSI_FONT_BOLD);
 
 	if (opts->bg)
 	{
-		fputs(COLOR_BG, stdout);
+		out_puts(OUT_STDOUT, COLOR_BG);
+	}
+
+	if (opts->sixel)
+	{
+		out_puts(OUT_STDOUT, ANSI_SIXEL_RIGHT_ON);
 	}
 
-	fputs(ANSI_CLEAR_SCREEN, stdout); // clear screen
-	fputs(ANSI_CURSOR_RESET, stdout); // cursor back to position 0,0
-	cli_echo(0);                      // don't show keyboard input
+	out_puts(OUT_STDOUT, ANSI_CLEAR_SCREEN); // clear screen
+	out_puts(OUT_STDOUT, ANSI_CURSOR_RESET); // cursor back to position 0,0
+	cli_echo(0);                             // don't show keyboard input
 	
 	// set the buffering to fully buffered, we're adult and flush ourselves
-	setvbuf(stdout, NULL, _IOFBF, 0);
+	out_buffered(OUT_STDOUT, 1);
 }
 
 /*
  * Make sure the terminal goes back to its normal state.
  */
 static void
-cli_reset()
+cli_reset(options_s *opts)
 {
-	fputs(ANSI_FONT_RESET, stdout);   // resets font colors and effects
-	fputs(ANSI_SHOW_CURSOR, stdout);  // show the cursor again
-	fputs(ANSI_CLEAR_SCREEN, stdout); // clear screen
-	fputs(ANSI_CURSOR_RESET, stdout); // cursor back to position 0,0
-	cli_echo(1);                      // show keyboard input
+	if (opts->sixel)
+	{
+		out_puts(OUT_STDOUT, ANSI_SIXEL_RIGHT_OFF);
+	}
 
-	setvbuf(stdout, NULL, _IOLBF, 0);
+	out_puts(OUT_STDOUT, ANSI_FONT_RESET);   // resets font colors and effects
+	out_puts(OUT_STDOUT, ANSI_SHOW_CURSOR);  // show the cursor again
+	out_puts(OUT_STDOUT, ANSI_CLEAR_SCREEN); // clear screen
+	out_puts(OUT_STDOUT, ANSI_CURSOR_RESET); // cursor back to position 0,0
+	out_flush(OUT_STDOUT);
+	cli_echo(1);                             // show keyboard input
+
+	out_buffered(OUT_STDOUT, 0);
 }
 
 /*
@@ -746,6 +3099,7 @@ main(int argc, char **argv)
 {
 	// set signal handlers for the usual susspects plus window resize
 	struct sigaction sa = { .sa_handler = &on_signal };
+	sigaction(SIGHUP,   &sa, NULL);
 	sigaction(SIGINT,   &sa, NULL);
 	sigaction(SIGQUIT,  &sa, NULL);
 	sigaction(SIGTERM,  &sa, NULL);
@@ -757,13 +3111,13 @@ main(int argc, char **argv)
 
 	if (opts.help)
 	{
-		help(argv[0], stdout);
+		help(argv[0], OUT_STDOUT);
 		return EXIT_SUCCESS;
 	}
 
 	if (opts.version)
 	{
-		version(stdout);
+		version(OUT_STDOUT);
 		return EXIT_SUCCESS;
 	}
 
@@ -791,18 +3145,63 @@ main(int argc, char **argv)
 	clamp_uint8(&opts.speed, SPEED_FACTOR_MIN, SPEED_FACTOR_MAX);
 	clamp_uint8(&opts.drops, DROPS_FACTOR_MIN, DROPS_FACTOR_MAX);
 	clamp_uint8(&opts.error, ERROR_FACTOR_MIN, ERROR_FACTOR_MAX);
+#ifndef FAKESTEAK_TINY
+	if (opts.budget)
+	{
+		clamp_uint8(&opts.budget, BUDGET_MIN, BUDGET_MAX);
+	}
+
+	if (opts.video)
+	{
+		if (opts.video_w == 0 || opts.video_h == 0)
+		{
+			opts.video_w = VIDEO_W_DEF;
+			opts.video_h = VIDEO_H_DEF;
+		}
+		if (opts.cell_w == 0 || opts.cell_h == 0)
+		{
+			opts.cell_w = CELL_W_DEF;
+			opts.cell_h = CELL_H_DEF;
+		}
+		if (opts.frames == 0)
+		{
+			opts.frames = VIDEO_FRAMES_DEF;
+		}
+		if (opts.threads == 0)
+		{
+			long cores = sysconf(_SC_NPROCESSORS_ONLN);
+			opts.threads = cores < 1 ? 1 : 
+				cores < VIDEO_THREADS_MAX ? cores : VIDEO_THREADS_MAX;
+		}
+		clamp_uint8(&opts.threads, 1, VIDEO_THREADS_MAX);
+	}
+#endif
 
 	// get the terminal dimensions
 	struct winsize ws = { 0 };
-	if (cli_wsize(&ws) == -1)
+	if (cli_wsize(&ws) == -1 && !opts.bench && !opts.video)
 	{
-		fprintf(stderr, "Failed to determine terminal size\n");
+		out_error("Failed to determine terminal size");
 		return EXIT_FAILURE;
 	}
 
+	// benchmarks don't need a terminal, we just pick a size then
+	if (opts.bench && (ws.ws_col == 0 || ws.ws_row == 0))
+	{
+		ws.ws_col = BENCH_COLS;
+		ws.ws_row = BENCH_ROWS;
+	}
+
+	// neither does video export, where the frame and cell size decide
+	if (opts.video)
+	{
+		ws.ws_col = (opts.video_w + opts.cell_w - 1) / opts.cell_w;
+		ws.ws_row = (opts.video_h + opts.cell_h - 1) / opts.cell_h;
+	}
+
 	if (ws.ws_col == 0 || ws.ws_row == 0)
 	{
-		fprintf(stderr, "Terminal size not appropriate\n");
+		out_error("Terminal size not appropriate");
 		return EXIT_FAILURE;
 	}
 
@@ -812,9 +3211,7 @@ main(int argc, char **argv)
 	float error_ratio = ERROR_BASE_VALUE * opts.error;
 
 	// set up the nanosleep struct
-	uint8_t  sec  = (int) wait;
-	uint32_t nsec = (wait - sec) * NS_PER_SEC;
-	struct timespec ts = { .tv_sec = sec, .tv_nsec = nsec };
+	struct timespec ts = time_ts(wait);
 	
 	// seed the random number generator with the current unix time
 	srand(opts.rands);
@@ -824,9 +3221,101 @@ main(int argc, char **argv)
 	mat_init(&mat, ws.ws_row, ws.ws_col, drops_ratio);
 	mat_fill(&mat);
 
+#ifndef FAKESTEAK_TINY
+	// we can't know the terminal's default background, so assume black
+	uint8_t bg[3] = { 0 };
+	if (opts.bg)
+	{
+		color_rgb(COLOR_BG, bg);
+	}
+
+	// set up the pixel graphics renderer, if requested
+	sixel_s six = { 0 };
+	uint16_t cw = 0;
+	uint16_t ch = 0;
+	cli_csize(&ws, &cw, &ch);
+	if (opts.sixel && six_init(&six, &mat, cw, ch, bg) == -1)
+	{
+		out_error("Failed to set up pixel graphics");
+		mat_free(&mat);
+		return EXIT_FAILURE;
+	}
+
+	// video export: render frames as fast as we can and pipe them to stdout
+	if (opts.video)
+	{
+		if (isatty(STDOUT_FILENO))
+		{
+			out_error("Refusing to write video to a terminal");
+			mat_free(&mat);
+			return EXIT_FAILURE;
+		}
+
+		// notice a closed pipe as a failed write, rather than dying
+		struct sigaction ign = { .sa_handler = SIG_IGN };
+		sigaction(SIGPIPE, &ign, NULL);
+
+		video_s vid = { 0 };
+		int err = vid_init(&vid, &mat, opts.video, opts.video_w, opts.video_h,
+				opts.cell_w, opts.cell_h, bg, opts.threads) == -1;
+		if (err)
+		{
+			out_error("Failed to set up video export");
+		}
+		else if (vid_run(&vid, &mat, error_ratio, 1.0 / wait, opts.frames) == -1)
+		{
+			out_error("Failed to write video");
+			err = 1;
+		}
+		vid_free(&vid);
+		mat_free(&mat);
+		return err ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// benchmark mode: no terminal shenanigans, just render and measure
+	if (opts.bench)
+	{
+		vt_s vt = { 0 };
+		int err = opts.vt && vt_init(&vt, mat.rows, mat.cols) == -1;
+		if (!err)
+		{
+			err = bench(&mat, opts.sixel ? &six : NULL, opts.vt ? &vt : NULL, 
+					error_ratio, opts.bench);
+		}
+		if (opts.vt) vt_free(&vt);
+		if (opts.sixel) six_free(&six);
+		mat_free(&mat);
+		return err ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	// set up the shared memory segment, if requested
+	publisher_s pub = { 0 };
+	if (opts.shm && pub_init(&pub, opts.shm, &mat) == -1)
+	{
+		out_error(errno == EEXIST ? 
+				"Shared memory object exists already (see /dev/shm)" :
+				"Failed to set up shared memory object");
+		mat_free(&mat);
+		return EXIT_FAILURE;
+	}
+#endif
+
+	// find out if we can have the terminal draw each frame in one go
+	int sync = cli_sync_query();
+
 	// prepare the terminal for our shenanigans
 	cli_setup(&opts);
 
+#ifndef FAKESTEAK_TINY
+	// keep an eye on our CPU usage, if requested
+	governor_s gov = { .load = 1.0 };
+	if (opts.budget) gov_init(&gov, opts.budget);
+
+	stats_s stats = { 0 };
+	uint64_t started = time_ns(CLOCK_MONOTONIC);
+#endif
+	float error_eff = error_ratio;
+
 	running = 1;
 	while(running)
 	{
@@ -836,21 +3325,56 @@ main(int argc, char **argv)
 			cli_wsize(&ws);
 			
 			// reinitialize the matrix
-			mat_init(&mat, ws.ws_row, ws.ws_col, drops_ratio);
+			mat_init(&mat, ws.ws_row, ws.ws_col, mat.drop_ratio);
 			mat_fill(&mat);
 			mat_rain(&mat); // TODO maybe this isn't desired?
+#ifndef FAKESTEAK_TINY
+			// cells might have changed size, too
+			cli_csize(&ws, &cw, &ch);
+			if (opts.sixel) six_init(&six, &mat, cw, ch, bg);
+#endif
 			resized = 0;
 		}
 
-		cli_clear();
-		mat_print(&mat);                // print to the terminal
-		mat_glitch(&mat, error_ratio);  // apply random defects
+		cli_clear(sync);
+#ifdef FAKESTEAK_TINY
+		mat_print(&mat, OUT_STDOUT);    // print to the terminal
+		cli_flush(sync);
+#else
+		if (opts.sixel) six_print(&six, &mat, OUT_STDOUT); // print to the terminal
+		else            mat_print(&mat, OUT_STDOUT);       // ... as text
+		cli_flush(sync);
+		if (opts.shm) pub_frame(&pub, &mat); // publish to shared memory
+#endif
+		mat_glitch(&mat, error_eff);    // apply random defects
 		mat_update(&mat);               // move all drops down one row
+#ifndef FAKESTEAK_TINY
+		stats.frames += 1;
+
+		// scale density, glitches and frame rate to stay within budget
+		if (opts.budget && gov_adjust(&gov, stats.frames))
+		{
+			mat.drop_ratio = drops_ratio * gov.load;
+			error_eff      = error_ratio * gov.load;
+			ts             = time_ts(wait / gov.load);
+		}
+#endif
 		nanosleep(&ts, NULL);
 	}
 
 	// make sure all is back to normal before we exit
+#ifdef FAKESTEAK_TINY
+	cli_reset(&opts);
+#else
+	stats.ns_total = time_ns(CLOCK_MONOTONIC) - started;
+	if (opts.shm) pub_free(&pub);
+	if (opts.sixel) six_free(&six);
+	cli_reset(&opts);
+	if (opts.budget)
+	{
+		stats_print(&stats, &mat, &gov, error_eff, gov.load / wait, stderr);
+	}
+#endif
 	mat_free(&mat);	
-	cli_reset();
 	return EXIT_SUCCESS;
 }